@@ -0,0 +1,77 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+// Forwards to an upstream resource and counts what reaches it. Rooms carve
+// their arenas out of one of these, so its counters are the heap traffic
+// the rooms actually cause: a pool that has warmed up answers joins and
+// renames from memory it already holds and these stop moving.
+class CountingResource : public std::pmr::memory_resource {
+public:
+  explicit CountingResource(
+      std::pmr::memory_resource *upstream = std::pmr::new_delete_resource())
+      : upstream_(upstream) {}
+
+  std::uint64_t allocations() const {
+    return allocations_.load(std::memory_order_relaxed);
+  }
+  // Bytes currently allocated through this resource.
+  std::int64_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+
+private:
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+    void *p = upstream_->allocate(bytes, alignment);
+    allocations_.fetch_add(1, std::memory_order_relaxed);
+    bytes_.fetch_add(static_cast<std::int64_t>(bytes),
+                     std::memory_order_relaxed);
+    return p;
+  }
+
+  void do_deallocate(void *p, std::size_t bytes,
+                     std::size_t alignment) override {
+    upstream_->deallocate(p, bytes, alignment);
+    bytes_.fetch_sub(static_cast<std::int64_t>(bytes),
+                     std::memory_order_relaxed);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource &other) const
+      noexcept override {
+    return this == &other;
+  }
+
+  std::pmr::memory_resource *upstream_;
+  std::atomic<std::uint64_t> allocations_{0};
+  std::atomic<std::int64_t> bytes_{0};
+};
+
+// A room's private allocator: a pool over a growing monotonic buffer. Freed
+// blocks go back to the pool for the next join or rename; nothing returns
+// to the heap until the room is destroyed, which releases it all at once.
+// Not thread-safe: used under the owning room's lock.
+class RoomArena : public std::pmr::memory_resource {
+public:
+  static constexpr std::size_t kInitialBytes = 4 << 10;
+
+  explicit RoomArena(std::pmr::memory_resource *upstream)
+      : buffer_(kInitialBytes, upstream), pool_(&buffer_) {}
+  RoomArena(const RoomArena &) = delete;
+  RoomArena &operator=(const RoomArena &) = delete;
+
+private:
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+    return pool_.allocate(bytes, alignment);
+  }
+  void do_deallocate(void *p, std::size_t bytes,
+                     std::size_t alignment) override {
+    pool_.deallocate(p, bytes, alignment);
+  }
+  bool do_is_equal(const std::pmr::memory_resource &other) const
+      noexcept override {
+    return this == &other;
+  }
+
+  std::pmr::monotonic_buffer_resource buffer_;
+  std::pmr::unsynchronized_pool_resource pool_;
+};
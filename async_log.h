@@ -0,0 +1,140 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <crow/logging.h>
+
+// A Crow log handler that hands lines to a writer thread instead of writing
+// to stderr on the caller's thread. Lines go into a bounded ring; when the
+// writer falls behind, new lines are dropped and counted rather than making
+// a request thread wait on the terminal.
+class AsyncLogHandler : public crow::ILogHandler {
+public:
+  static constexpr std::size_t kCapacity = 8192;
+
+  AsyncLogHandler() : ring_(kCapacity) {
+    writer_ = std::thread([this] { run(); });
+  }
+
+  ~AsyncLogHandler() { stop(); }
+  AsyncLogHandler(const AsyncLogHandler &) = delete;
+  AsyncLogHandler &operator=(const AsyncLogHandler &) = delete;
+
+  // Crow 1.0 passes the message by value, later releases by reference;
+  // whichever the base declares is the one overridden.
+  void log(std::string message, crow::LogLevel level) {
+    push(std::move(message), level);
+  }
+  void log(const std::string &message, crow::LogLevel level) {
+    push(message, level);
+  }
+
+  // Writes out everything still queued and joins the writer thread.
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopping_)
+        return;
+      stopping_ = true;
+    }
+    wake_.notify_one();
+    writer_.join();
+  }
+
+  std::uint64_t dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct Entry {
+    std::chrono::system_clock::time_point time;
+    crow::LogLevel level;
+    std::string message;
+  };
+
+  void push(std::string message, crow::LogLevel level) {
+    auto now = std::chrono::system_clock::now();
+    bool wake;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (count_ == ring_.size()) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      Entry &entry = ring_[(head_ + count_) % ring_.size()];
+      entry.time = now;
+      entry.level = level;
+      entry.message = std::move(message);
+      wake = count_++ == 0;
+    }
+    if (wake)
+      wake_.notify_one();
+  }
+
+  void run() {
+    std::vector<Entry> batch;
+    std::string out;
+    std::uint64_t reported = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      wake_.wait(lock, [this] { return stopping_ || count_ > 0; });
+      if (count_ == 0 && stopping_)
+        break;
+      batch.clear();
+      for (; count_ > 0; --count_, head_ = (head_ + 1) % ring_.size())
+        batch.push_back(std::move(ring_[head_]));
+      lock.unlock();
+
+      out.clear();
+      for (const Entry &entry : batch)
+        format(out, entry);
+      std::uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+      if (dropped != reported) {
+        format(out, Entry{std::chrono::system_clock::now(),
+                          crow::LogLevel::Warning,
+                          "Log ring full, dropped " +
+                              std::to_string(dropped - reported) + " lines"});
+        reported = dropped;
+      }
+      std::fwrite(out.data(), 1, out.size(), stderr);
+      std::fflush(stderr);
+      lock.lock();
+    }
+  }
+
+  static void format(std::string &out, const Entry &entry) {
+    static const char *const names[] = {"DEBUG   ", "INFO    ", "WARNING ",
+                                        "ERROR   ", "CRITICAL"};
+    std::time_t time = std::chrono::system_clock::to_time_t(entry.time);
+    std::tm tm;
+    gmtime_r(&time, &tm);
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+    auto level = static_cast<std::size_t>(entry.level);
+    out += "(";
+    out += stamp;
+    out += ") [";
+    out += level < 5 ? names[level] : names[4];
+    out += "] ";
+    out += entry.message;
+    if (out.empty() || out.back() != '\n')
+      out += '\n';
+  }
+
+  std::vector<Entry> ring_;
+  std::size_t head_ = 0;
+  std::size_t count_ = 0;
+  std::atomic<std::uint64_t> dropped_{0};
+  bool stopping_ = false;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::thread writer_;
+};
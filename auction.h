@@ -0,0 +1,264 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include "catalog.h"
+#include "lot_plan.h"
+#include "money.h"
+#include "squad.h"
+
+// One accepted bid in a lot's history.
+struct BidRecord {
+  Money amount;
+  std::uint16_t team;     // id in Auction::teams()
+  std::uint16_t sequence; // 1-based bid number within the lot
+};
+static_assert(sizeof(BidRecord) == 8, "bid records should pack into 8 bytes");
+
+// One player sold.
+struct Sale {
+  std::uint32_t player; // catalog index
+  std::uint32_t lot;    // 1-based lot number
+  Money price;
+  std::uint16_t team; // id in Auction::teams()
+};
+
+// Live bidding state for one room. Not thread-safe: the owning room's lock
+// serializes every call, which is what makes bid validation atomic.
+class Auction {
+public:
+  enum class Status { TeamSelection, InProgress, Paused, Cancelled, Completed };
+  enum class BidResult {
+    Accepted,
+    NotInProgress,
+    AlreadyHighest,
+    WrongAmount,
+    OverPurse,
+    SquadFull,
+    OverseasFull,
+  };
+
+  struct LotResult {
+    std::uint32_t player = 0;
+    std::string team;
+    Money price;
+    std::uint32_t bids = 0;
+    bool sold() const { return !team.empty(); }
+  };
+
+  Status status;
+  // The bid history is allocated from `memory`, e.g. a room's arena, which
+  // must outlive the auction.
+  explicit Auction(
+      SquadRules rules = {},
+      std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+      : status(Status::TeamSelection), bids_(memory),
+        squads_(std::move(rules)) {}
+
+  // Auctions the catalog players as `plan` lays out, one lot each.
+  void start(const Catalog &catalog, LotPlan plan) {
+    load(catalog, std::move(plan));
+    status = order_.empty() ? Status::Completed : Status::InProgress;
+  }
+
+  // Restores a recovered auction at its first lot with no bids or sales.
+  // The sales are replayed through restore_sale(), then seek() opens the
+  // lot it was on and that lot's bids are replayed through place_bid().
+  void resume(const Catalog &catalog, LotPlan plan, Status resumed) {
+    load(catalog, std::move(plan));
+    status = resumed;
+  }
+
+  // Moves a resumed auction to lot `lot_number`, queuing any re-auction
+  // rounds before it from the restored sales.
+  void seek(std::size_t lot_number) {
+    while (lot_number > order_.size()) {
+      std::size_t queued = order_.size();
+      queue_next_round();
+      if (order_.size() == queued)
+        break;
+    }
+    current_ = std::min(lot_number - 1, order_.size());
+  }
+
+  const Catalog &catalog() const { return *catalog_; }
+  bool has_lot() const { return current_ < order_.size(); }
+  // Catalog index of the player under the hammer; requires has_lot().
+  std::uint32_t current_player() const { return order_[current_]; }
+  std::size_t lot_number() const { return current_ + 1; }
+  // Lots queued so far; grows as each round ends with players unsold.
+  std::size_t lots_queued() const { return order_.size(); }
+  // Catalog index of the player up in lot `lot_number`; requires
+  // lot_number <= lots_queued().
+  std::uint32_t player_at(std::size_t lot_number) const {
+    return order_[lot_number - 1];
+  }
+  std::uint64_t plan_seed() const { return plan_.seed; }
+  bool has_bids() const { return !bids_.empty(); }
+  const std::string &high_bidder() const {
+    static const std::string none;
+    return has_bids() ? teams_[bids_.back().team] : none;
+  }
+  Money high_bid() const { return has_bids() ? bids_.back().amount : Money(); }
+  std::uint32_t bid_count() const {
+    return static_cast<std::uint32_t>(bids_.size());
+  }
+  // Accepted bids on the open lot, oldest first.
+  const std::pmr::vector<BidRecord> &bids() const { return bids_; }
+  const StringPool &teams() const { return teams_; }
+  // Players sold so far, in lot order.
+  const std::vector<Sale> &sales() const { return sales_; }
+  const Squads &squads() const { return squads_; }
+  // The most `team` may bid on the next lot.
+  Money max_bid(std::string_view team) const {
+    return squads_[teams_.find(team)].max_bid;
+  }
+  // The room's one copy of a team name; players hold it as a view.
+  std::string_view intern_team(std::string_view team) {
+    return teams_[teams_.intern(team)];
+  }
+
+  // The only amount the next bid may be: the base price to open, then one
+  // step of the increment ladder above the current high bid.
+  Money next_bid() const {
+    if (!has_bids())
+      return has_lot() ? catalog_->base_price(current_player()) : Money();
+    return high_bid() + get_bid_increment(high_bid());
+  }
+
+  BidResult place_bid(std::string_view team, Money amount) {
+    if (status != Status::InProgress || !has_lot())
+      return BidResult::NotInProgress;
+    std::uint16_t teamId = teams_.intern(team);
+    if (has_bids() && bids_.back().team == teamId)
+      return BidResult::AlreadyHighest;
+    if (amount != next_bid())
+      return BidResult::WrongAmount;
+    switch (squads_.check(*catalog_, teamId, current_player(), amount)) {
+    case Squads::Check::Ok:
+      break;
+    case Squads::Check::OverPurse:
+      return BidResult::OverPurse;
+    case Squads::Check::SquadFull:
+      return BidResult::SquadFull;
+    case Squads::Check::OverseasFull:
+      return BidResult::OverseasFull;
+    }
+
+    auto sequence = static_cast<std::uint16_t>(bids_.size() + 1);
+    bids_.push_back(BidRecord{amount, teamId, sequence});
+    return BidResult::Accepted;
+  }
+
+  // Ends bidding on the current lot and advances to the next one.
+  LotResult close_lot() {
+    LotResult result;
+    if (has_lot()) {
+      result.player = current_player();
+      result.team = high_bidder();
+      result.price = high_bid();
+      result.bids = bid_count();
+      if (has_bids())
+        record_sale(bids_.back().team, result.player, result.price);
+      if (++current_ == order_.size())
+        queue_next_round();
+    }
+    reset_bids();
+    if (!has_lot() && status == Status::InProgress)
+      status = Status::Completed;
+    return result;
+  }
+
+  // Re-applies a sale from a recovered snapshot, in lot order.
+  void restore_sale(std::string_view team, std::uint32_t player,
+                    std::uint32_t lot, Money price) {
+    if (player < catalog_->size())
+      record_sale(teams_.intern(team), player, lot, price);
+  }
+
+private:
+  void load(const Catalog &catalog, LotPlan plan) {
+    catalog_ = &catalog;
+    plan_ = std::move(plan);
+    order_ = plan_.order;
+    current_ = 0;
+    round_ = 0;
+    round_begin_ = 0;
+    reset_bids();
+    sales_.clear();
+    squads_.reset(catalog);
+  }
+
+  void reset_bids() { bids_.clear(); }
+
+  void record_sale(std::uint16_t team, std::uint32_t player, Money price) {
+    record_sale(team, player, static_cast<std::uint32_t>(lot_number()),
+                price);
+  }
+  void record_sale(std::uint16_t team, std::uint32_t player,
+                   std::uint32_t lot, Money price) {
+    sales_.push_back(Sale{player, lot, price, team});
+    squads_.record_sale(*catalog_, team, player, price);
+  }
+
+  // Called when the last queued lot closes: queues the next re-auction
+  // round, the players of the round just ended that went unsold, in the
+  // order the plan drew for it.
+  void queue_next_round() {
+    if (round_ >= plan_.reauctions.size())
+      return;
+    std::vector<bool> again(catalog_->size());
+    for (std::size_t i = round_begin_; i < order_.size(); ++i)
+      again[order_[i]] = true;
+    // Sales are in lot order, so the round's are at the back, behind any
+    // from later rounds when seek() is catching up after a restore.
+    for (auto it = sales_.rbegin();
+         it != sales_.rend() && it->lot > round_begin_; ++it) {
+      if (it->lot <= order_.size())
+        again[it->player] = false;
+    }
+    round_begin_ = order_.size();
+    for (std::uint32_t player : plan_.reauctions[round_++]) {
+      if (again[player])
+        order_.push_back(player);
+    }
+  }
+
+  const Catalog *catalog_ = nullptr;
+  LotPlan plan_;
+  // The main rounds, then each re-auction round as it is queued.
+  std::vector<std::uint32_t> order_;
+  std::size_t current_ = 0;
+  // Re-auction rounds queued, and the index in order_ the last round began.
+  std::size_t round_ = 0;
+  std::size_t round_begin_ = 0;
+  StringPool teams_;
+  // Cleared on every lot, so its capacity settles at the longest bidding
+  // war and a warmed-up arena serves it without the heap.
+  std::pmr::vector<BidRecord> bids_;
+  std::vector<Sale> sales_;
+  Squads squads_;
+};
+
+inline const char *bid_result_reason(Auction::BidResult result) {
+  switch (result) {
+  case Auction::BidResult::Accepted:
+    return "Accepted";
+  case Auction::BidResult::NotInProgress:
+    return "No lot is open for bidding";
+  case Auction::BidResult::AlreadyHighest:
+    return "Your team already holds the highest bid";
+  case Auction::BidResult::WrongAmount:
+    return "Bid does not match the next increment";
+  case Auction::BidResult::OverPurse:
+    return "Not enough purse left for this bid";
+  case Auction::BidResult::SquadFull:
+    return "Your squad is full";
+  case Auction::BidResult::OverseasFull:
+    return "Your squad has no overseas slots left";
+  }
+  return "Unknown";
+}
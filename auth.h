@@ -0,0 +1,155 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include <jwt-cpp/jwt.h>
+
+struct Claims {
+  std::string username;
+  std::string roomId;
+  std::string role;
+};
+
+// Signs and verifies the session cookies. The verifier is built once, and
+// tokens that verified recently are answered from a bounded LRU cache, so a
+// reconnect storm costs one HMAC per distinct token rather than per request.
+class Auth {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  Auth(std::string secret, std::string issuer, std::size_t capacity = 16384,
+       std::chrono::seconds ttl = std::chrono::minutes(5))
+      : secret_(std::move(secret)), issuer_(std::move(issuer)),
+        verifier_(jwt::verify()
+                      .allow_algorithm(jwt::algorithm::hs256{secret_})
+                      .with_issuer(issuer_)),
+        shard_capacity_(std::max<std::size_t>(1, capacity / kShards)),
+        ttl_(ttl) {}
+
+  std::string sign(const Claims &claims) {
+    auto token =
+        jwt::create()
+            .set_issuer(issuer_)
+            .set_type("JWT")
+            .set_issued_now()
+            .set_payload_claim("username", jwt::claim(claims.username))
+            .set_payload_claim("room-id", jwt::claim(claims.roomId))
+            .set_payload_claim("role", jwt::claim(claims.role))
+            .sign(jwt::algorithm::hs256{secret_});
+    remember(token, claims, Clock::now() + ttl_);
+    return token;
+  }
+
+  // Returns the token's claims, or nullopt (and the reason in `error`) if it
+  // does not verify.
+  std::optional<Claims> verify(const std::string &token,
+                               std::string *error = nullptr) {
+    if (auto cached = lookup(token)) {
+      hits_.fetch_add(1, std::memory_order_relaxed);
+      return cached;
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+
+    try {
+      auto decoded = jwt::decode(token);
+      verifier_.verify(decoded);
+      Claims claims{decoded.get_payload_claim("username").as_string(),
+                    decoded.get_payload_claim("room-id").as_string(),
+                    decoded.get_payload_claim("role").as_string()};
+
+      auto expires = Clock::now() + ttl_;
+      if (decoded.has_expires_at()) {
+        auto left =
+            decoded.get_expires_at() - std::chrono::system_clock::now();
+        expires = std::min(
+            expires, Clock::now() +
+                         std::chrono::duration_cast<Clock::duration>(left));
+      }
+      remember(token, claims, expires);
+      return claims;
+    } catch (const std::exception &e) {
+      if (error)
+        *error = e.what();
+      return std::nullopt;
+    }
+  }
+
+  std::uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+  std::uint64_t misses() const {
+    return misses_.load(std::memory_order_relaxed);
+  }
+
+private:
+  static constexpr std::size_t kShards = 16;
+
+  struct Entry {
+    std::size_t digest;
+    std::string token;
+    Claims claims;
+    Clock::time_point expires;
+  };
+
+  // Entries are keyed by a hash of the token, but the full token is kept and
+  // compared so that a colliding token can never borrow another's claims.
+  struct alignas(64) Shard {
+    std::mutex mutex;
+    std::list<Entry> lru;
+    std::unordered_map<std::size_t, std::list<Entry>::iterator> index;
+  };
+
+  Shard &shard_for(std::size_t digest) { return shards_[digest % kShards]; }
+
+  std::optional<Claims> lookup(const std::string &token) {
+    std::size_t digest = std::hash<std::string>{}(token);
+    Shard &shard = shard_for(digest);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(digest);
+    if (it == shard.index.end() || it->second->token != token)
+      return std::nullopt;
+    if (it->second->expires <= Clock::now()) {
+      shard.lru.erase(it->second);
+      shard.index.erase(it);
+      return std::nullopt;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    return it->second->claims;
+  }
+
+  void remember(const std::string &token, const Claims &claims,
+                Clock::time_point expires) {
+    if (expires <= Clock::now())
+      return;
+    std::size_t digest = std::hash<std::string>{}(token);
+    Shard &shard = shard_for(digest);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(digest);
+    if (it != shard.index.end()) {
+      shard.lru.erase(it->second);
+      shard.index.erase(it);
+    }
+    if (shard.lru.size() >= shard_capacity_) {
+      shard.index.erase(shard.lru.back().digest);
+      shard.lru.pop_back();
+    }
+    shard.lru.push_front(Entry{digest, token, claims, expires});
+    shard.index[digest] = shard.lru.begin();
+  }
+
+  std::string secret_;
+  std::string issuer_;
+  decltype(jwt::verify()) verifier_;
+  std::size_t shard_capacity_;
+  std::chrono::seconds ttl_;
+  std::array<Shard, kShards> shards_;
+  std::atomic<std::uint64_t> hits_{0};
+  std::atomic<std::uint64_t> misses_{0};
+};
@@ -0,0 +1,144 @@
+// Catalog loading benchmark: the old per-category re-parse of the CSV
+// against one Catalog::load and set lookups.
+//
+//   g++ -O2 -std=c++17 bench_catalog.cpp -o bench_catalog
+//   ./bench_catalog [csv] [scale]
+//
+// With scale > 1 the CSV is replicated that many times (names suffixed) into
+// a temporary file so larger catalogs can be measured.
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "catalog.h"
+
+struct Player {
+  std::string name;
+  std::string country;
+  std::string role;
+  std::string prev_team;
+  std::string cap_status;
+  float base_price;
+};
+
+// The loader main.cpp used to call once per entry in CATEGORY_ORDER.
+std::vector<Player>
+load_players_for_category(const std::string &csv_file,
+                          const std::string &target_category) {
+  std::ifstream file(csv_file);
+  std::vector<Player> players;
+  std::string line;
+
+  std::getline(file, line);
+
+  while (std::getline(file, line)) {
+    std::stringstream ss(line);
+    std::string item;
+    Player p;
+    std::string player_category;
+
+    std::getline(ss, player_category, ',');
+    if (player_category != target_category)
+      continue;
+
+    std::getline(ss, p.name, ',');
+    std::getline(ss, p.country, ',');
+    std::getline(ss, p.prev_team, ',');
+    std::getline(ss, p.cap_status, ',');
+    std::getline(ss, p.role, ',');
+    std::getline(ss, item, ',');
+    p.base_price = std::stof(item);
+
+    players.push_back(p);
+  }
+
+  return players;
+}
+
+std::string scale_csv(const std::string &csv_file, int scale) {
+  std::ifstream in(csv_file);
+  std::string header;
+  std::getline(in, header);
+  std::vector<std::string> rows;
+  for (std::string line; std::getline(in, line);)
+    rows.push_back(line);
+
+  auto path = std::filesystem::temp_directory_path() / "bench_catalog.csv";
+  std::ofstream out(path);
+  out << header << "\n";
+  for (int copy = 0; copy < scale; ++copy) {
+    for (const auto &row : rows) {
+      auto comma = row.find(',', row.find(',') + 1);
+      out << row.substr(0, comma) << " #" << copy << row.substr(comma)
+          << "\n";
+    }
+  }
+  return path.string();
+}
+
+template <typename Fn> double time_ms(Fn &&fn, int repeat) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < repeat; ++i)
+    fn();
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / repeat;
+}
+
+int main(int argc, char **argv) {
+  std::string csv_file = argc > 1 ? argv[1] : "Auction_List.csv";
+  int scale = argc > 2 ? std::stoi(argv[2]) : 1;
+  if (scale > 1)
+    csv_file = scale_csv(csv_file, scale);
+
+  Catalog probe = Catalog::load(csv_file);
+  std::vector<std::string> sets;
+  for (std::size_t i = 0; i < probe.sets().size(); ++i)
+    sets.push_back(probe.sets()[static_cast<std::uint16_t>(i)]);
+  int repeat = std::max(1, 200 / static_cast<int>(scale));
+
+  std::size_t legacy_players = 0;
+  double legacy = time_ms(
+      [&] {
+        legacy_players = 0;
+        for (const auto &set : sets)
+          legacy_players += load_players_for_category(csv_file, set).size();
+      },
+      repeat);
+
+  std::size_t catalog_players = 0;
+  double catalog = time_ms(
+      [&] {
+        Catalog c = Catalog::load(csv_file);
+        catalog_players = 0;
+        for (const auto &set : sets)
+          catalog_players += c.players_in_set(set).size();
+      },
+      repeat);
+
+  std::size_t found = 0;
+  double lookup = time_ms(
+      [&] {
+        found = 0;
+        for (std::uint32_t i = 0; i < probe.size(); ++i)
+          found += probe.find(probe.name(i)) == i;
+      },
+      repeat);
+
+  std::cout << "rows=" << probe.size() << " sets=" << sets.size() << "\n";
+  std::cout << "per-category reparse: " << legacy << " ms (" << legacy_players
+            << " players)\n";
+  std::cout << "catalog load + sets:  " << catalog << " ms ("
+            << catalog_players << " players)\n";
+  std::cout << "speedup: " << legacy / catalog << "x\n";
+  std::cout << "name lookups: " << lookup * 1e6 / probe.size()
+            << " ns each (" << found << " found)\n";
+  if (scale > 1)
+    std::remove(csv_file.c_str());
+  return 0;
+}
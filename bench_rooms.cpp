@@ -0,0 +1,101 @@
+// Room lock contention benchmark: messages/sec against room count, comparing
+// one global mutex (the old rooms_mutex layout) with RoomDirectory plus a
+// mutex per room.
+//
+//   g++ -O2 -std=c++17 -pthread bench_rooms.cpp -o bench_rooms
+//   ./bench_rooms [threads] [messages-per-thread]
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "room_directory.h"
+
+struct BenchRoom {
+  std::mutex mutex;
+  std::unordered_map<int, std::string> players;
+};
+
+// Stand-in for a "Change Team" handler: a lookup and a small string write.
+void apply_message(BenchRoom &room, int player, int seq) {
+  std::string &team = room.players[player];
+  team.assign(seq % 2 ? "CSK" : "MI");
+}
+
+std::string room_id(int i) { return "room" + std::to_string(i); }
+
+template <typename Fn>
+double run(int threads, int messages, int rooms, Fn &&send) {
+  std::atomic<bool> go{false};
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      while (!go.load(std::memory_order_acquire))
+        std::this_thread::yield();
+      for (int i = 0; i < messages; ++i)
+        send((t + i * threads) % rooms, t, i);
+    });
+  }
+  auto start = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (auto &w : workers)
+    w.join();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return threads * static_cast<double>(messages) / elapsed.count();
+}
+
+double bench_global(int threads, int messages, int rooms) {
+  std::unordered_map<std::string, BenchRoom> wsrooms;
+  std::mutex rooms_mutex;
+  std::vector<std::string> ids;
+  for (int r = 0; r < rooms; ++r) {
+    ids.push_back(room_id(r));
+    wsrooms[ids.back()];
+  }
+  return run(threads, messages, rooms, [&](int r, int player, int seq) {
+    std::lock_guard<std::mutex> lock(rooms_mutex);
+    apply_message(wsrooms[ids[r]], player, seq);
+  });
+}
+
+double bench_sharded(int threads, int messages, int rooms) {
+  RoomDirectory<BenchRoom> wsrooms;
+  std::vector<std::string> ids;
+  for (int r = 0; r < rooms; ++r) {
+    ids.push_back(room_id(r));
+    wsrooms.create(ids.back());
+  }
+  return run(threads, messages, rooms, [&](int r, int player, int seq) {
+    auto room = wsrooms.find(ids[r]);
+    std::lock_guard<std::mutex> lock(room->mutex);
+    apply_message(*room, player, seq);
+  });
+}
+
+int main(int argc, char **argv) {
+  int threads = argc > 1 ? std::stoi(argv[1])
+                         : std::max(2u, std::thread::hardware_concurrency());
+  int messages = argc > 2 ? std::stoi(argv[2]) : 200000;
+
+  std::cout << "threads=" << threads << " messages/thread=" << messages
+            << "\n";
+  std::cout << std::setw(8) << "rooms" << std::setw(16) << "global msg/s"
+            << std::setw(16) << "sharded msg/s" << std::setw(10) << "speedup"
+            << "\n";
+  for (int rooms = 1; rooms <= 512; rooms *= 2) {
+    double global = bench_global(threads, messages, rooms);
+    double sharded = bench_sharded(threads, messages, rooms);
+    std::cout << std::setw(8) << rooms << std::setw(16)
+              << static_cast<long long>(global) << std::setw(16)
+              << static_cast<long long>(sharded) << std::setw(9)
+              << std::fixed << std::setprecision(2) << sharded / global
+              << "x\n";
+  }
+  return 0;
+}
@@ -0,0 +1,192 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <fcntl.h>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "money.h"
+
+// Small set of distinct strings addressed by dense ids. Used for the catalog
+// columns that only take a handful of values (set, country, team, ...).
+// Move-only: the lookup keys are views into the stored values.
+class StringPool {
+public:
+  StringPool() = default;
+  StringPool(const StringPool &) = delete;
+  StringPool &operator=(const StringPool &) = delete;
+  StringPool(StringPool &&) = default;
+  StringPool &operator=(StringPool &&) = default;
+
+  std::uint16_t intern(std::string_view value) {
+    auto it = ids_.find(value);
+    if (it != ids_.end())
+      return it->second;
+    auto id = static_cast<std::uint16_t>(values_.size());
+    values_.emplace_back(value);
+    ids_.emplace(values_.back(), id);
+    return id;
+  }
+
+  // Returns size() if the value was never interned.
+  std::uint16_t find(std::string_view value) const {
+    auto it = ids_.find(value);
+    return it == ids_.end() ? static_cast<std::uint16_t>(values_.size())
+                            : it->second;
+  }
+
+  const std::string &operator[](std::uint16_t id) const { return values_[id]; }
+  std::size_t size() const { return values_.size(); }
+
+private:
+  std::deque<std::string> values_;
+  std::unordered_map<std::string_view, std::uint16_t> ids_;
+};
+
+// The player list from Auction_List.csv, parsed once into one column per
+// field. Players are addressed by their row index. Move-only: the name index
+// points into the names buffer.
+class Catalog {
+public:
+  Catalog() = default;
+  Catalog(const Catalog &) = delete;
+  Catalog &operator=(const Catalog &) = delete;
+  Catalog(Catalog &&) = default;
+  Catalog &operator=(Catalog &&) = default;
+
+  static Catalog load(const std::string &csv_file) {
+    Catalog catalog;
+    int fd = ::open(csv_file.c_str(), O_RDONLY);
+    if (fd < 0)
+      return catalog;
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+      void *data = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+        catalog.parse(std::string_view(static_cast<const char *>(data),
+                                       static_cast<std::size_t>(st.st_size)));
+        ::munmap(data, st.st_size);
+      }
+    }
+    ::close(fd);
+    return catalog;
+  }
+
+  std::size_t size() const { return base_price_.size(); }
+
+  std::string_view name(std::uint32_t i) const {
+    return std::string_view(names_.data() + name_offsets_[i],
+                            name_offsets_[i + 1] - name_offsets_[i]);
+  }
+  const std::string &set(std::uint32_t i) const { return sets_[set_[i]]; }
+  const std::string &country(std::uint32_t i) const {
+    return countries_[country_[i]];
+  }
+  const std::string &prev_team(std::uint32_t i) const {
+    return teams_[team_[i]];
+  }
+  const std::string &cap_status(std::uint32_t i) const {
+    return cap_statuses_[cap_status_[i]];
+  }
+  const std::string &role(std::uint32_t i) const { return roles_[role_[i]]; }
+  Money base_price(std::uint32_t i) const { return base_price_[i]; }
+
+  std::uint16_t set_id(std::uint32_t i) const { return set_[i]; }
+  std::uint16_t country_id(std::uint32_t i) const { return country_[i]; }
+  std::uint16_t role_id(std::uint32_t i) const { return role_[i]; }
+  std::uint16_t cap_status_id(std::uint32_t i) const {
+    return cap_status_[i];
+  }
+  const StringPool &sets() const { return sets_; }
+  const StringPool &countries() const { return countries_; }
+  const StringPool &cap_statuses() const { return cap_statuses_; }
+  const StringPool &roles() const { return roles_; }
+
+  // Players of a set in file order; empty for an unknown set.
+  const std::vector<std::uint32_t> &
+  players_in_set(std::string_view set) const {
+    static const std::vector<std::uint32_t> none;
+    std::uint16_t id = sets_.find(set);
+    return id < by_set_.size() ? by_set_[id] : none;
+  }
+
+  // Returns size() if no player has that name.
+  std::uint32_t find(std::string_view name) const {
+    auto it = by_name_.find(name);
+    return it == by_name_.end() ? static_cast<std::uint32_t>(size())
+                                : it->second;
+  }
+
+private:
+  void parse(std::string_view csv) {
+    std::size_t pos = csv.find('\n');
+    pos = pos == std::string_view::npos ? csv.size() : pos + 1;
+
+    std::string_view fields[7];
+    while (pos < csv.size()) {
+      std::size_t end = csv.find('\n', pos);
+      if (end == std::string_view::npos)
+        end = csv.size();
+      std::string_view line = csv.substr(pos, end - pos);
+      pos = end + 1;
+      if (!line.empty() && line.back() == '\r')
+        line.remove_suffix(1);
+      if (line.empty())
+        continue;
+
+      std::size_t count = 0;
+      for (std::size_t start = 0; count < 7; ++count) {
+        std::size_t comma = line.find(',', start);
+        fields[count] = line.substr(start, comma - start);
+        if (comma == std::string_view::npos) {
+          ++count;
+          break;
+        }
+        start = comma + 1;
+      }
+      if (count < 7)
+        continue;
+
+      set_.push_back(sets_.intern(fields[0]));
+      name_offsets_.push_back(static_cast<std::uint32_t>(names_.size()));
+      names_.insert(names_.end(), fields[1].begin(), fields[1].end());
+      country_.push_back(countries_.intern(fields[2]));
+      team_.push_back(teams_.intern(fields[3]));
+      cap_status_.push_back(cap_statuses_.intern(fields[4]));
+      role_.push_back(roles_.intern(fields[5]));
+      base_price_.push_back(Money::parse_crores(fields[6]));
+    }
+    name_offsets_.push_back(static_cast<std::uint32_t>(names_.size()));
+
+    // names_ is final now, so the name index can hold views into it.
+    by_set_.assign(sets_.size(), {});
+    by_name_.reserve(size());
+    for (std::uint32_t i = 0; i < size(); ++i) {
+      by_set_[set_[i]].push_back(i);
+      by_name_.emplace(name(i), i);
+    }
+  }
+
+  std::vector<char> names_;
+  std::vector<std::uint32_t> name_offsets_;
+  std::vector<std::uint16_t> set_;
+  std::vector<std::uint16_t> country_;
+  std::vector<std::uint16_t> team_;
+  std::vector<std::uint16_t> cap_status_;
+  std::vector<std::uint16_t> role_;
+  std::vector<Money> base_price_;
+
+  StringPool sets_;
+  StringPool countries_;
+  StringPool teams_;
+  StringPool cap_statuses_;
+  StringPool roles_;
+
+  std::vector<std::vector<std::uint32_t>> by_set_;
+  std::unordered_map<std::string_view, std::uint32_t> by_name_;
+};
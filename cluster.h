@@ -0,0 +1,492 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ws_client.h"
+
+// Multi-process mode. Each of N worker processes runs its own app on its own
+// port and owns the rooms whose id maps to it; the first character of a room
+// id names the owner. A Router on the public port reads the head of each
+// incoming connection, works out which room it is for and splices the
+// connection through to that room's worker:
+//
+//   POST /join-room/<id>     the owner of <id>
+//   /results/<id>, /rooms/<id>
+//                            the owner of <id>
+//   /wsrooms?spectate=<id>   the owner of <id>
+//   /metrics/<n>             worker n, so each has a stable scrape path
+//   anything with a token    the owner of the token's room-id claim
+//   anything else            round robin (e.g. /create-room, which then
+//                            mints an id its own worker owns, or
+//                            /results, whose worker gathers the others')
+//
+// A WebSocket upgrade stays spliced to its worker. Any other request is
+// forwarded with "Connection: close" and so is its response, so a browser
+// sends its next request on a new connection, which is routed afresh.
+//
+// The router runs every connection from one epoll loop with a buffer per
+// direction, so spectators held open through it cost memory, not threads.
+// A client gets kHeadTimeout to send its request head.
+namespace cluster {
+
+inline constexpr std::string_view kRoomIdChars =
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHJKLMNPQRSTUVWXYZ23456789";
+
+// Index of the worker, out of `workers`, that owns roomId.
+inline unsigned owner(std::string_view roomId, unsigned workers) {
+  if (workers <= 1 || roomId.empty())
+    return 0;
+  auto pos = kRoomIdChars.find(roomId.front());
+  return pos == std::string_view::npos ? 0
+                                       : static_cast<unsigned>(pos % workers);
+}
+
+inline std::string base64url_decode(std::string_view in) {
+  std::string out;
+  std::uint32_t bits = 0;
+  int count = 0;
+  for (char ch : in) {
+    int value;
+    if (ch >= 'A' && ch <= 'Z')
+      value = ch - 'A';
+    else if (ch >= 'a' && ch <= 'z')
+      value = ch - 'a' + 26;
+    else if (ch >= '0' && ch <= '9')
+      value = ch - '0' + 52;
+    else if (ch == '-' || ch == '+')
+      value = 62;
+    else if (ch == '_' || ch == '/')
+      value = 63;
+    else
+      break;
+    bits = bits << 6 | static_cast<std::uint32_t>(value);
+    count += 6;
+    if (count >= 8) {
+      count -= 8;
+      out.push_back(static_cast<char>(bits >> count & 0xff));
+    }
+  }
+  return out;
+}
+
+// Calls visit(header line) for each header of a head, until it returns
+// true.
+template <typename Visit>
+inline void for_each_header(std::string_view head, Visit &&visit) {
+  for (std::size_t pos = head.find("\r\n"); pos != std::string_view::npos;
+       pos = head.find("\r\n", pos + 2)) {
+    std::string_view header =
+        head.substr(pos + 2, head.find("\r\n", pos + 2) - pos - 2);
+    if (header.empty() || visit(header))
+      return;
+  }
+}
+
+inline bool header_is(std::string_view header, std::string_view name) {
+  return header.size() > name.size() &&
+         ::strncasecmp(header.data(), name.data(), name.size()) == 0;
+}
+
+// Whether a request head asks for a protocol upgrade, i.e. a WebSocket.
+inline bool is_upgrade(std::string_view head) {
+  bool upgrade = false;
+  for_each_header(head, [&](std::string_view header) {
+    return upgrade = header_is(header, "upgrade:");
+  });
+  return upgrade;
+}
+
+// A head, up to and including its blank line, with "Connection: close" in
+// place of any Connection header it had.
+inline std::string close_after(std::string_view head) {
+  std::string out(head.substr(0, head.find("\r\n") + 2));
+  for_each_header(head, [&](std::string_view header) {
+    if (!header_is(header, "connection:"))
+      out.append(header).append("\r\n");
+    return false;
+  });
+  out += "Connection: close\r\n\r\n";
+  return out;
+}
+
+// The room a request head is for, or "" if it names none. The token is only
+// decoded, not verified: the worker verifies it, and a forged claim at worst
+// reaches a worker that does not know the room.
+inline std::string room_of(std::string_view head) {
+  std::string_view line = head.substr(0, head.find("\r\n"));
+  for (std::string_view prefix : {" /join-room/", " /results/", " /rooms/"}) {
+    if (auto pos = line.find(prefix); pos != std::string_view::npos) {
+      std::string_view id = line.substr(pos + prefix.size());
+      return std::string(id.substr(0, id.find_first_of(" ?/")));
+    }
+  }
+  constexpr std::string_view spectate = "spectate=";
+  if (auto pos = line.find(spectate);
+      pos != std::string_view::npos && pos > 0 &&
+      (line[pos - 1] == '?' || line[pos - 1] == '&')) {
+    std::string_view id = line.substr(pos + spectate.size());
+    return std::string(id.substr(0, id.find_first_of(" &")));
+  }
+
+  std::string_view cookies;
+  for_each_header(head, [&](std::string_view header) {
+    if (!header_is(header, "cookie:"))
+      return false;
+    cookies = header.substr(7);
+    return true;
+  });
+  std::string_view value;
+  while (!cookies.empty()) {
+    std::string_view cookie = cookies.substr(0, cookies.find(';'));
+    cookies.remove_prefix(std::min(cookies.size(), cookie.size() + 1));
+    cookie.remove_prefix(std::min(cookie.size(),
+                                  cookie.find_first_not_of(' ')));
+    if (cookie.substr(0, 6) == "token=") {
+      value = cookie.substr(6);
+      break;
+    }
+  }
+  auto first = value.find('.');
+  auto second = value.find('.', first + 1);
+  if (first == std::string_view::npos || second == std::string_view::npos)
+    return {};
+  return json_field(
+      base64url_decode(value.substr(first + 1, second - first - 1)),
+      "room-id");
+}
+
+// The worker a /metrics/<n> head names, if n is one.
+inline bool metrics_worker(std::string_view head, unsigned workers,
+                           unsigned &worker) {
+  std::string_view line = head.substr(0, head.find("\r\n"));
+  constexpr std::string_view prefix = " /metrics/";
+  auto pos = line.find(prefix);
+  if (pos == std::string_view::npos)
+    return false;
+  std::string_view digits = line.substr(pos + prefix.size());
+  digits = digits.substr(0, digits.find_first_not_of("0123456789"));
+  if (digits.empty() || digits.size() > 4)
+    return false;
+  worker = 0;
+  for (char ch : digits)
+    worker = worker * 10 + static_cast<unsigned>(ch - '0');
+  return worker < workers;
+}
+
+class Router {
+public:
+  // Head bytes read before giving up on finding the end of the headers.
+  static constexpr std::size_t kMaxHead = 16 << 10;
+  // A client that has not sent a whole request head by then is dropped.
+  static constexpr auto kHeadTimeout = std::chrono::seconds(10);
+  // Bytes held for a side that is not reading before the router stops
+  // reading from the other.
+  static constexpr std::size_t kMaxPending = 256 << 10;
+
+  Router(int port, std::vector<Endpoint> workers)
+      : port_(port), workers_(std::move(workers)) {}
+  ~Router() {
+    for (auto &[id, conn] : conns_) {
+      for (int fd : conn.fd)
+        if (fd >= 0)
+          ::close(fd);
+    }
+    if (epoll_ >= 0)
+      ::close(epoll_);
+  }
+  Router(const Router &) = delete;
+  Router &operator=(const Router &) = delete;
+
+  // Serves every connection from one epoll loop on the calling thread,
+  // forever. Returns false if the port cannot be bound.
+  bool run() {
+    // A peer that hangs up mid-copy must not take the router down.
+    std::signal(SIGPIPE, SIG_IGN);
+    int listener = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int one = 1;
+    ::setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port_);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (::bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) !=
+            0 ||
+        ::listen(listener, SOMAXCONN) != 0) {
+      ::close(listener);
+      return false;
+    }
+    epoll_ = ::epoll_create1(0);
+    epoll_event listen_event{};
+    listen_event.events = EPOLLIN;
+    listen_event.data.u64 = kListener;
+    ::epoll_ctl(epoll_, EPOLL_CTL_ADD, listener, &listen_event);
+
+    epoll_event events[256];
+    for (;;) {
+      int n = ::epoll_wait(epoll_, events, 256, 1000);
+      for (int i = 0; i < n; ++i) {
+        if (events[i].data.u64 == kListener) {
+          accept_all(listener);
+          continue;
+        }
+        std::uint64_t id = events[i].data.u64 >> 1;
+        auto side = static_cast<int>(events[i].data.u64 & 1);
+        auto it = conns_.find(id);
+        if (it == conns_.end())
+          continue;
+        // Set true by any step that closed the connection.
+        bool done = false;
+        if (events[i].events & EPOLLOUT)
+          done = writable(id, it->second, side);
+        if (!done && events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+          done = readable(id, it->second, side);
+        if (!done)
+          update(id, it->second);
+      }
+      expire_heads();
+    }
+  }
+
+private:
+  static constexpr int kClient = 0;
+  static constexpr int kUpstream = 1;
+  static constexpr std::uint64_t kListener = ~std::uint64_t(0);
+
+  // One client connection and, once its head is in, the worker connection
+  // it is spliced to. Indexed by side, kClient or kUpstream.
+  struct Conn {
+    int fd[2] = {-1, -1};
+    // The request head until it is routed, then the response head while it
+    // is held back.
+    std::string head;
+    bool routed = false;
+    bool connecting = false;
+    // Hold back the response head to pass it on with "Connection: close".
+    bool rewrite = false;
+    // Bytes waiting to be written to each side.
+    std::string pending[2];
+    // Each side has finished sending, and has been told the other has.
+    bool eof[2] = {false, false};
+    bool shut[2] = {false, false};
+    // Each side's epoll interest, once registered.
+    std::uint32_t events[2] = {0, 0};
+    bool registered[2] = {false, false};
+  };
+
+  void accept_all(int listener) {
+    for (;;) {
+      int client = ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK);
+      if (client < 0)
+        return;
+      int one = 1;
+      ::setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      std::uint64_t id = next_id_++;
+      Conn &conn = conns_[id];
+      conn.fd[kClient] = client;
+      heads_.emplace_back(std::chrono::steady_clock::now() + kHeadTimeout, id);
+      update(id, conn);
+    }
+  }
+
+  // Drops connections whose head is overdue. Deadlines are queued in the
+  // order they fall due.
+  void expire_heads() {
+    auto now = std::chrono::steady_clock::now();
+    while (!heads_.empty() && heads_.front().first <= now) {
+      auto it = conns_.find(heads_.front().second);
+      if (it != conns_.end() && !it->second.routed)
+        close(heads_.front().second, it->second);
+      heads_.pop_front();
+    }
+  }
+
+  // Returns true if the connection was closed.
+  bool readable(std::uint64_t id, Conn &conn, int side) {
+    if (side == kUpstream && conn.connecting)
+      return bad_gateway(id, conn);
+    char buf[16 << 10];
+    ssize_t n = ::recv(conn.fd[side], buf, sizeof(buf), 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+      return false;
+    if (!conn.routed) {
+      if (n <= 0)
+        return close(id, conn);
+      conn.head.append(buf, static_cast<std::size_t>(n));
+      if (conn.head.find("\r\n\r\n") != std::string::npos)
+        return route(id, conn);
+      return conn.head.size() > kMaxHead && close(id, conn);
+    }
+    if (n < 0)
+      return close(id, conn);
+    int to = 1 - side;
+    if (n == 0) {
+      conn.eof[side] = true;
+      // The worker hung up mid-head; pass on what there is.
+      if (side == kUpstream && conn.rewrite) {
+        conn.pending[to] += conn.head;
+        conn.rewrite = false;
+      }
+      return false;
+    }
+    std::string_view data(buf, static_cast<std::size_t>(n));
+    if (side == kUpstream && conn.rewrite) {
+      conn.head.append(data);
+      std::size_t body = conn.head.find("\r\n\r\n");
+      if (body == std::string::npos && conn.head.size() <= kMaxHead)
+        return false;
+      conn.rewrite = false;
+      if (body == std::string::npos)
+        conn.pending[to] += conn.head;
+      else
+        conn.pending[to] +=
+            close_after(std::string_view(conn.head).substr(0, body + 4)) +
+            conn.head.substr(body + 4);
+      conn.head.clear();
+    } else {
+      conn.pending[to].append(data);
+    }
+    return writable(id, conn, to);
+  }
+
+  // Writes what the side will take. Returns true if the connection was
+  // closed.
+  bool writable(std::uint64_t id, Conn &conn, int side) {
+    if (side == kUpstream && conn.connecting) {
+      int error = 0;
+      socklen_t len = sizeof(error);
+      ::getsockopt(conn.fd[side], SOL_SOCKET, SO_ERROR, &error, &len);
+      if (error != 0)
+        return bad_gateway(id, conn);
+      conn.connecting = false;
+    }
+    std::string &out = conn.pending[side];
+    while (!out.empty()) {
+      ssize_t n = ::send(conn.fd[side], out.data(), out.size(), 0);
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        break;
+      if (n < 0 && errno != EINTR)
+        return close(id, conn);
+      if (n > 0)
+        out.erase(0, static_cast<std::size_t>(n));
+    }
+    return false;
+  }
+
+  // Picks the worker for a complete head and starts connecting to it.
+  // Whatever came after the head is the start of the body.
+  bool route(std::uint64_t id, Conn &conn) {
+    conn.routed = true;
+    std::size_t end = conn.head.find("\r\n\r\n") + 4;
+    bool upgrade = is_upgrade(std::string_view(conn.head).substr(0, end));
+    if (upgrade)
+      conn.pending[kUpstream] = std::move(conn.head);
+    else
+      conn.pending[kUpstream] =
+          close_after(std::string_view(conn.head).substr(0, end)) +
+          conn.head.substr(end);
+    conn.head.clear();
+    conn.rewrite = !upgrade;
+
+    auto workers = static_cast<unsigned>(workers_.size());
+    unsigned worker;
+    if (!metrics_worker(conn.pending[kUpstream], workers, worker)) {
+      std::string roomId = room_of(conn.pending[kUpstream]);
+      worker = roomId.empty() ? next_++ % workers : owner(roomId, workers);
+    }
+    const Endpoint &to = workers_[worker];
+    int upstream = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(to.port);
+    ::inet_pton(AF_INET, to.host.c_str(), &addr.sin_addr);
+    conn.fd[kUpstream] = upstream;
+    if (upstream < 0 ||
+        (::connect(upstream, reinterpret_cast<sockaddr *>(&addr),
+                   sizeof(addr)) != 0 &&
+         errno != EINPROGRESS))
+      return bad_gateway(id, conn);
+    int one = 1;
+    ::setsockopt(upstream, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    conn.connecting = true;
+    return false;
+  }
+
+  bool bad_gateway(std::uint64_t id, Conn &conn) {
+    // Best effort: a fresh socket's send buffer takes it whole.
+    constexpr std::string_view reply =
+        "HTTP/1.1 502 Bad Gateway\r\nContent-Length: 0\r\n"
+        "Connection: close\r\n\r\n";
+    ::send(conn.fd[kClient], reply.data(), reply.size(), 0);
+    return close(id, conn);
+  }
+
+  // Passes on each side's end of stream once what it sent is written,
+  // closes the pair when both are done, and registers the interest left.
+  void update(std::uint64_t id, Conn &conn) {
+    for (int side : {kClient, kUpstream}) {
+      int to = 1 - side;
+      if (conn.eof[side] && conn.pending[to].empty() && !conn.shut[to] &&
+          !(to == kUpstream && conn.connecting)) {
+        ::shutdown(conn.fd[to], SHUT_WR);
+        conn.shut[to] = true;
+      }
+    }
+    if (conn.shut[kClient] && conn.shut[kUpstream]) {
+      close(id, conn);
+      return;
+    }
+    for (int side : {kClient, kUpstream}) {
+      if (conn.fd[side] < 0)
+        continue;
+      std::uint32_t events = 0;
+      bool reading = side == kClient || !conn.connecting;
+      if (reading && !conn.eof[side] &&
+          conn.pending[1 - side].size() < kMaxPending)
+        events |= EPOLLIN;
+      if (!conn.pending[side].empty() ||
+          (side == kUpstream && conn.connecting))
+        events |= EPOLLOUT;
+      if (conn.registered[side] && events == conn.events[side])
+        continue;
+      epoll_event event{};
+      event.events = events;
+      event.data.u64 = id << 1 | static_cast<std::uint64_t>(side);
+      ::epoll_ctl(epoll_, conn.registered[side] ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+                  conn.fd[side], &event);
+      conn.events[side] = events;
+      conn.registered[side] = true;
+    }
+  }
+
+  // Always returns true, for the callers' "closed" results.
+  bool close(std::uint64_t id, Conn &conn) {
+    for (int fd : conn.fd)
+      if (fd >= 0)
+        ::close(fd);
+    conns_.erase(id);
+    return true;
+  }
+
+  int port_;
+  std::vector<Endpoint> workers_;
+  int epoll_ = -1;
+  unsigned next_ = 0;
+  std::uint64_t next_id_ = 0;
+  std::unordered_map<std::uint64_t, Conn> conns_;
+  // Connections still reading a head, by deadline.
+  std::deque<std::pair<std::chrono::steady_clock::time_point, std::uint64_t>>
+      heads_;
+};
+
+} // namespace cluster
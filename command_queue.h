@@ -0,0 +1,156 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// A room's inbound commands: many producers, one consumer at a time, no
+// locks. Producers push onto an atomic stack. Whichever push finds the
+// queue idle makes its caller the drainer, which takes the whole stack in
+// one exchange, reverses it into arrival order and hands it over as a
+// batch, until nothing is left. While a drain is under way the stack ends
+// in a marker rather than null, so later pushes see a busy queue and leave
+// their commands to the drainer already running.
+//
+// Commands are applied in the order their pushes took effect, whichever
+// threads they came from and however they were batched. A drain may stop
+// after a few batches and leave the queue claimed; whoever continues it
+// (see Executor) is then the only drainer until it runs dry.
+template <typename T> class CommandQueue {
+public:
+  CommandQueue() = default;
+  CommandQueue(const CommandQueue &) = delete;
+  CommandQueue &operator=(const CommandQueue &) = delete;
+  ~CommandQueue() {
+    Link *link = head_.load(std::memory_order_acquire);
+    while (link && link != &draining_) {
+      Link *next = link->next;
+      delete static_cast<Node *>(link);
+      link = next;
+    }
+  }
+
+  // Returns true if the queue was idle: the caller must now drain() it.
+  bool push(T value) {
+    Node *node = new Node(std::move(value));
+    Link *head = head_.load(std::memory_order_relaxed);
+    do {
+      node->next = head;
+    } while (!head_.compare_exchange_weak(head, node, std::memory_order_release,
+                                          std::memory_order_relaxed));
+    return head == nullptr;
+  }
+
+  // Calls apply(std::vector<T> &) with each batch, oldest command first,
+  // until the queue is empty and idle again or max_batches were applied.
+  // Only the caller whose push() returned true may drain. Returns true if
+  // it stopped with commands left: the queue stays claimed, and the caller
+  // must see that drain() is called again, e.g. from another thread.
+  template <typename Apply>
+  bool drain(Apply &&apply, std::size_t max_batches =
+                                std::numeric_limits<std::size_t>::max()) {
+    std::vector<T> batch;
+    for (std::size_t batches = 0;;) {
+      if (batches == max_batches) {
+        Link *expected = &draining_;
+        return !head_.compare_exchange_strong(expected, nullptr,
+                                              std::memory_order_acq_rel);
+      }
+      Link *link = head_.exchange(&draining_, std::memory_order_acquire);
+      if (link == &draining_) {
+        Link *expected = &draining_;
+        if (head_.compare_exchange_strong(expected, nullptr,
+                                          std::memory_order_acq_rel))
+          return false;
+        continue;
+      }
+      batch.clear();
+      while (link && link != &draining_) {
+        Node *node = static_cast<Node *>(link);
+        link = node->next;
+        batch.push_back(std::move(node->value));
+        delete node;
+      }
+      std::reverse(batch.begin(), batch.end());
+      apply(batch);
+      ++batches;
+    }
+  }
+
+private:
+  struct Link {
+    Link *next = nullptr;
+  };
+  struct Node : Link {
+    explicit Node(T v) : value(std::move(v)) {}
+    T value;
+  };
+
+  std::atomic<Link *> head_{nullptr};
+  // Ends the stack while a drain is under way; never dereferenced.
+  Link draining_;
+};
+
+// A fixed set of threads running posted tasks in order. Rooms whose queue
+// outlasted a drain on the io thread continue here.
+class Executor {
+public:
+  Executor() = default;
+  ~Executor() { stop(); }
+  Executor(const Executor &) = delete;
+  Executor &operator=(const Executor &) = delete;
+
+  void start(unsigned threads) {
+    for (unsigned i = 0; i < std::max(1u, threads); ++i)
+      threads_.emplace_back([this] { run(); });
+  }
+
+  void post(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.push_back(std::move(task));
+    }
+    wake_.notify_one();
+  }
+
+  // Finishes the tasks already running and drops the rest.
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto &thread : threads_) {
+      if (thread.joinable())
+        thread.join();
+    }
+  }
+
+private:
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      wake_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+      if (stopping_)
+        return;
+      auto task = std::move(tasks_.front());
+      tasks_.pop_front();
+      lock.unlock();
+      task();
+      lock.lock();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::deque<std::function<void()>> tasks_;
+  bool stopping_ = false;
+  std::vector<std::thread> threads_;
+};
@@ -0,0 +1,404 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <dirent.h>
+#include <fcntl.h>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "protocol.h"
+
+// Durable room history: an append-only journal of state-changing events plus
+// periodic snapshots, kept as numbered files in one directory:
+//
+//   journal.<gen>   records appended since snapshot <gen> was started
+//   snapshot.<gen>  full room state as of the start of journal.<gen>
+//
+// A record is  length:varint body crc32:u32le  where body is a type byte and
+// varint/length-delimited fields read back in the order they were written.
+// Recovery loads the newest complete snapshot, replays the journals from
+// its generation on and stops at the first torn or corrupt record.
+//
+// append() only copies into a buffer. A writer thread group-commits the
+// buffer every commit interval with one write() and one fdatasync(), so the
+// bid path never waits on the disk; a crash loses at most that interval.
+
+enum class EventType : std::uint8_t {
+  RoomCreated = 1,
+  PlayerJoined = 2,
+  Renamed = 3,
+  TeamChanged = 4,
+  AuctionStarted = 5,
+  BidPlaced = 6,
+  LotClosed = 7,
+  PlayerLeft = 8,
+  RoomClosed = 9,
+  RoomSnapshot = 16,
+};
+
+namespace journal {
+
+inline std::uint32_t crc32(std::string_view data) {
+  static const auto table = [] {
+    std::array<std::uint32_t, 256> t{};
+    for (std::uint32_t i = 0; i < 256; ++i) {
+      std::uint32_t c = i;
+      for (int k = 0; k < 8; ++k)
+        c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      t[i] = c;
+    }
+    return t;
+  }();
+  std::uint32_t crc = 0xffffffffu;
+  for (char ch : data)
+    crc = table[(crc ^ static_cast<std::uint8_t>(ch)) & 0xff] ^ (crc >> 8);
+  return crc ^ 0xffffffffu;
+}
+
+} // namespace journal
+
+// One journal or snapshot record under construction.
+class Record {
+public:
+  explicit Record(EventType type) { body_.push_back(static_cast<char>(type)); }
+
+  Record &text(std::string_view value) {
+    protocol::put_varint(body_, value.size());
+    body_.append(value);
+    return *this;
+  }
+  Record &number(std::int64_t value) {
+    protocol::put_varint(body_, protocol::zigzag(value));
+    return *this;
+  }
+
+  // Appends the framed record to out.
+  void frame(std::string &out) const {
+    protocol::put_varint(out, body_.size());
+    out.append(body_);
+    std::uint32_t crc = journal::crc32(body_);
+    for (int i = 0; i < 4; ++i)
+      out.push_back(static_cast<char>(crc >> (8 * i)));
+  }
+
+private:
+  std::string body_;
+};
+
+// Reads a record's fields back in order. A short record reads as empty
+// strings and zeros, and ok() turns false.
+class RecordReader {
+public:
+  explicit RecordReader(std::string_view body) : in_(body) {
+    type_ = in_.empty() ? EventType{} : static_cast<EventType>(in_.front());
+    if (!in_.empty())
+      in_.remove_prefix(1);
+  }
+
+  EventType type() const { return type_; }
+  bool ok() const { return ok_; }
+
+  std::string text() {
+    std::uint64_t size;
+    if (!protocol::get_varint(in_, size) || size > in_.size()) {
+      ok_ = false;
+      return {};
+    }
+    std::string value(in_.substr(0, size));
+    in_.remove_prefix(size);
+    return value;
+  }
+  std::int64_t number() {
+    std::uint64_t value;
+    if (!protocol::get_varint(in_, value)) {
+      ok_ = false;
+      return 0;
+    }
+    return protocol::unzigzag(value);
+  }
+
+private:
+  std::string_view in_;
+  EventType type_;
+  bool ok_ = true;
+};
+
+class EventLog {
+public:
+  using Clock = std::chrono::steady_clock;
+  using Apply = std::function<void(RecordReader &)>;
+  using Sink = std::function<void(const Record &)>;
+  // Writes every room's state through the sink.
+  using Snapshotter = std::function<void(const Sink &)>;
+
+  struct Stats {
+    std::uint64_t records = 0;
+    std::uint64_t commits = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t snapshots = 0;
+  };
+
+  explicit EventLog(std::string dir,
+                    std::chrono::milliseconds commit_interval =
+                        std::chrono::milliseconds(5),
+                    std::chrono::seconds snapshot_interval =
+                        std::chrono::seconds(60))
+      : dir_(std::move(dir)), commit_interval_(commit_interval),
+        snapshot_interval_(snapshot_interval) {
+    ::mkdir(dir_.c_str(), 0755);
+  }
+
+  ~EventLog() { stop(); }
+  EventLog(const EventLog &) = delete;
+  EventLog &operator=(const EventLog &) = delete;
+
+  // Moves the log to another directory. Call before recover().
+  void set_directory(std::string dir) {
+    dir_ = std::move(dir);
+    ::mkdir(dir_.c_str(), 0755);
+  }
+
+  // Feeds the newest snapshot and every later journal record to apply,
+  // oldest first. Returns the number of records applied. Call once, before
+  // start().
+  std::size_t recover(const Apply &apply) {
+    std::vector<std::uint64_t> snapshots = list("snapshot.");
+    std::vector<std::uint64_t> journals = list("journal.");
+    std::uint64_t base = snapshots.empty() ? 0 : snapshots.back();
+
+    std::size_t applied = 0;
+    if (!snapshots.empty())
+      applied += replay(path("snapshot.", base), apply);
+    for (std::uint64_t gen : journals) {
+      if (gen >= base)
+        applied += replay(path("journal.", gen), apply);
+    }
+    generation_ = std::max(base, journals.empty() ? 0 : journals.back()) + 1;
+    return applied;
+  }
+
+  // Opens a fresh journal segment and starts the group-commit thread.
+  void start(Snapshotter snapshotter) {
+    snapshotter_ = std::move(snapshotter);
+    open_segment(generation_);
+    last_snapshot_ = Clock::now();
+    running_ = true;
+    writer_ = std::thread([this] { run(); });
+  }
+
+  // Commits whatever is buffered and joins the writer thread.
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!running_)
+        return;
+      running_ = false;
+    }
+    wake_.notify_one();
+    writer_.join();
+    commit();
+    if (fd_ >= 0)
+      ::close(fd_);
+    fd_ = -1;
+  }
+
+  void append(const Record &record) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    record.frame(pending_);
+    ++pending_records_;
+  }
+
+  Stats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+private:
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+      wake_.wait_for(lock, commit_interval_);
+      lock.unlock();
+      commit();
+      if (snapshotter_ && Clock::now() - last_snapshot_ >= snapshot_interval_)
+        snapshot();
+      lock.lock();
+    }
+  }
+
+  // Writes and syncs the buffered records. Only the writer thread (or stop()
+  // after it has exited) touches the segment fd, so it needs no locking.
+  void commit() {
+    std::string batch;
+    std::uint64_t records;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (pending_.empty())
+        return;
+      batch.swap(pending_);
+      records = pending_records_;
+      pending_records_ = 0;
+    }
+    write_all(fd_, batch);
+    ::fdatasync(fd_);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.records += records;
+    stats_.bytes += batch.size();
+    ++stats_.commits;
+  }
+
+  // Starts journal.<gen+1>, then writes snapshot.<gen+1> from live state.
+  // Events that land in the new journal while rooms are being snapshotted
+  // may also be in the snapshot; replay has to treat them idempotently.
+  void snapshot() {
+    std::uint64_t gen = generation_ + 1;
+    commit();
+    open_segment(gen);
+
+    std::string tmp = path("snapshot.", gen) + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+      return;
+    std::string buffer;
+    snapshotter_([&](const Record &record) {
+      record.frame(buffer);
+      if (buffer.size() >= (1 << 16)) {
+        write_all(fd, buffer);
+        buffer.clear();
+      }
+    });
+    write_all(fd, buffer);
+    ::fsync(fd);
+    ::close(fd);
+    ::rename(tmp.c_str(), path("snapshot.", gen).c_str());
+
+    for (std::uint64_t old : list("journal.")) {
+      if (old < gen)
+        ::unlink(path("journal.", old).c_str());
+    }
+    for (std::uint64_t old : list("snapshot.")) {
+      if (old < gen)
+        ::unlink(path("snapshot.", old).c_str());
+    }
+    last_snapshot_ = Clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.snapshots;
+  }
+
+  void open_segment(std::uint64_t gen) {
+    int fd = ::open(path("journal.", gen).c_str(),
+                    O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd_ >= 0)
+      ::close(fd_);
+    fd_ = fd;
+    generation_ = gen;
+  }
+
+  std::size_t replay(const std::string &file, const Apply &apply) {
+    std::string data;
+    if (!read_file(file, data))
+      return 0;
+    std::string_view in(data);
+    std::size_t applied = 0;
+    while (!in.empty()) {
+      std::uint64_t size;
+      if (!protocol::get_varint(in, size) || size + 4 > in.size())
+        break;
+      std::string_view body = in.substr(0, size);
+      std::uint32_t crc = 0;
+      for (int i = 0; i < 4; ++i)
+        crc |= static_cast<std::uint32_t>(
+                   static_cast<std::uint8_t>(in[size + i]))
+               << (8 * i);
+      if (crc != journal::crc32(body))
+        break;
+      in.remove_prefix(size + 4);
+      RecordReader reader(body);
+      apply(reader);
+      ++applied;
+    }
+    return applied;
+  }
+
+  std::string path(const char *prefix, std::uint64_t gen) const {
+    return dir_ + "/" + prefix + std::to_string(gen);
+  }
+
+  // Generations of the complete files named <prefix><gen>, ascending.
+  std::vector<std::uint64_t> list(const std::string &prefix) const {
+    std::vector<std::uint64_t> gens;
+    DIR *dir = ::opendir(dir_.c_str());
+    if (!dir)
+      return gens;
+    while (dirent *entry = ::readdir(dir)) {
+      std::string_view name(entry->d_name);
+      if (name.substr(0, prefix.size()) != prefix)
+        continue;
+      name.remove_prefix(prefix.size());
+      if (name.empty() ||
+          name.find_first_not_of("0123456789") != std::string_view::npos)
+        continue;
+      gens.push_back(std::stoull(std::string(name)));
+    }
+    ::closedir(dir);
+    std::sort(gens.begin(), gens.end());
+    return gens;
+  }
+
+  static bool read_file(const std::string &file, std::string &data) {
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (::fstat(fd, &st) == 0)
+      data.resize(static_cast<std::size_t>(st.st_size));
+    std::size_t done = 0;
+    while (done < data.size()) {
+      ssize_t n = ::read(fd, &data[done], data.size() - done);
+      if (n <= 0)
+        break;
+      done += static_cast<std::size_t>(n);
+    }
+    data.resize(done);
+    ::close(fd);
+    return true;
+  }
+
+  static void write_all(int fd, const std::string &data) {
+    std::size_t done = 0;
+    while (done < data.size()) {
+      ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+      if (n <= 0)
+        return;
+      done += static_cast<std::size_t>(n);
+    }
+  }
+
+  std::string dir_;
+  std::chrono::milliseconds commit_interval_;
+  std::chrono::seconds snapshot_interval_;
+  Snapshotter snapshotter_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable wake_;
+  std::string pending_;
+  std::uint64_t pending_records_ = 0;
+  Stats stats_;
+  bool running_ = false;
+  std::thread writer_;
+
+  int fd_ = -1;
+  std::uint64_t generation_ = 0;
+  Clock::time_point last_snapshot_;
+};
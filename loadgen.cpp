@@ -0,0 +1,181 @@
+// Bid latency load generator for server.cpp.
+//
+//   g++ -O2 -std=c++17 -pthread loadgen.cpp -o loadgen
+//   ./loadgen [--host 127.0.0.1] [--port 18080] [--bidders 8] [--lots 20]
+//             [--bids-per-lot 50] [--p99-target-us 1000]
+//
+// Creates a room, joins every bidder on its own team, starts the auction and
+// has all bidders race for each next increment. Latency runs from sending
+// "Place Bid" to receiving the "Bid Accepted" broadcast for that bid. Exits
+// non-zero when p99 misses the target.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "ws_client.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  Endpoint server;
+  int bidders = 8;
+  int lots = 20;
+  int bids_per_lot = 50;
+  long p99_target_us = 1000;
+};
+
+struct BidderStats {
+  std::vector<long> latencies_us;
+  std::uint64_t rejected = 0;
+};
+
+int main(int argc, char **argv) {
+  Options opt;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string flag = argv[i];
+    std::string value = argv[i + 1];
+    if (flag == "--host")
+      opt.server.host = value;
+    else if (flag == "--port")
+      opt.server.port = std::stoi(value);
+    else if (flag == "--bidders")
+      opt.bidders = std::stoi(value);
+    else if (flag == "--lots")
+      opt.lots = std::stoi(value);
+    else if (flag == "--bids-per-lot")
+      opt.bids_per_lot = std::stoi(value);
+    else if (flag == "--p99-target-us")
+      opt.p99_target_us = std::stol(value);
+  }
+
+  HttpResult leader = http_post(opt.server, "/create-room");
+  std::string roomId = json_field(leader.body, "room-id");
+  if (leader.status != 200 || roomId.empty() || leader.token.empty()) {
+    std::cerr << "create-room failed (" << leader.status << ")\n";
+    return 2;
+  }
+  std::vector<std::string> tokens;
+  for (int i = 0; i < opt.bidders; ++i) {
+    HttpResult joined = http_post(opt.server, "/join-room/" + roomId);
+    if (joined.status != 200 || joined.token.empty()) {
+      std::cerr << "join-room failed (" << joined.status << ")\n";
+      return 2;
+    }
+    tokens.push_back(joined.token);
+  }
+
+  std::atomic<int> ready{0};
+  std::atomic<bool> done{false};
+  std::vector<BidderStats> stats(opt.bidders);
+  std::vector<std::thread> threads;
+
+  for (int i = 0; i < opt.bidders; ++i) {
+    threads.emplace_back([&, i] {
+      WsClient ws;
+      if (!ws.open(opt.server, tokens[i])) {
+        std::cerr << "bidder " << i << " failed to connect\n";
+        ready.fetch_add(1);
+        return;
+      }
+      std::string team = "T" + std::to_string(i);
+      ws.send("{\"type\":\"Change Team\",\"newTeam\":\"" + team + "\"}");
+
+      std::unordered_map<std::int64_t, Clock::time_point> inflight;
+      std::int64_t ref = 0;
+      std::string msg;
+      while (ws.receive(msg)) {
+        std::string type = json_field(msg, "type");
+        if (type == "Your Team" && json_field(msg, "team") == team) {
+          ready.fetch_add(1);
+        } else if (type == "Bid Rejected") {
+          ++stats[i].rejected;
+        } else if (type == "Auction Complete") {
+          break;
+        } else if (type == "Lot Open" || type == "Bid Accepted") {
+          if (type == "Bid Accepted" && json_field(msg, "team") == team) {
+            auto it = inflight.find(std::stoll(json_field(msg, "ref")));
+            if (it != inflight.end()) {
+              auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                  Clock::now() - it->second);
+              stats[i].latencies_us.push_back(us.count());
+              inflight.erase(it);
+            }
+            continue;
+          }
+          if (type == "Lot Open" && done.load())
+            break;
+          ++ref;
+          inflight[ref] = Clock::now();
+          ws.send("{\"type\":\"Place Bid\",\"amount\":" +
+                  json_field(msg, "nextBid") +
+                  ",\"ref\":" + std::to_string(ref) + "}");
+        }
+      }
+    });
+  }
+
+  WsClient control;
+  if (!control.open(opt.server, leader.token)) {
+    std::cerr << "leader failed to connect\n";
+    return 2;
+  }
+  while (ready.load() < opt.bidders)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  auto start = Clock::now();
+  control.send("{\"type\":\"Start Auction\"}");
+  int closed = 0;
+  int accepted = 0;
+  std::string msg;
+  while (closed < opt.lots && control.receive(msg)) {
+    std::string type = json_field(msg, "type");
+    if (type == "Auction Complete")
+      break;
+    if (type == "Lot Open")
+      accepted = 0;
+    if (type == "Bid Accepted" && ++accepted == opt.bids_per_lot) {
+      if (++closed == opt.lots)
+        done.store(true);
+      control.send("{\"type\":\"Close Lot\"}");
+    }
+  }
+  done.store(true);
+  for (auto &t : threads)
+    t.join();
+  std::chrono::duration<double> elapsed = Clock::now() - start;
+
+  std::vector<long> all;
+  std::uint64_t rejected = 0;
+  for (const auto &s : stats) {
+    all.insert(all.end(), s.latencies_us.begin(), s.latencies_us.end());
+    rejected += s.rejected;
+  }
+  if (all.empty()) {
+    std::cerr << "no bids were accepted\n";
+    return 2;
+  }
+  std::sort(all.begin(), all.end());
+  auto pct = [&](double p) {
+    return all[std::min(all.size() - 1,
+                        static_cast<std::size_t>(p * all.size()))];
+  };
+
+  std::cout << "accepted=" << all.size() << " rejected=" << rejected
+            << " bids/s=" << static_cast<long>(all.size() / elapsed.count())
+            << "\n";
+  std::cout << "bid-to-broadcast us: p50=" << pct(0.50)
+            << " p90=" << pct(0.90) << " p99=" << pct(0.99)
+            << " max=" << all.back() << "\n";
+  if (pct(0.99) > opt.p99_target_us) {
+    std::cout << "FAIL: p99 above target of " << opt.p99_target_us << "us\n";
+    return 1;
+  }
+  std::cout << "PASS: p99 within target of " << opt.p99_target_us << "us\n";
+  return 0;
+}
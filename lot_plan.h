@@ -0,0 +1,83 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "catalog.h"
+#include "rng.h"
+
+// CATEGORY_ORDER from an env file: the sets to auction, in order, e.g.
+// "CATEGORY_ORDER=MQ1,MQ2,BA1". Empty if the file or the line is missing.
+inline std::vector<std::string>
+read_category_order(const std::string &filename) {
+  std::ifstream env_file(filename);
+  std::string line;
+
+  while (std::getline(env_file, line)) {
+    if (line.rfind("CATEGORY_ORDER=", 0) == 0) {
+      std::string categories = line.substr(15);
+      std::vector<std::string> result;
+      std::stringstream ss(categories);
+      std::string token;
+      while (std::getline(ss, token, ',')) {
+        result.push_back(token);
+      }
+      return result;
+    }
+  }
+
+  return {};
+}
+
+// Every lot of an auction, drawn up when it starts. The main rounds are
+// fixed outright. Each re-auction round after them is a full ordering of the
+// same players, of which only those that went unsold in the round before
+// are put up again; which ones that is only the bidding can tell.
+struct LotPlan {
+  std::vector<std::uint32_t> order;
+  std::vector<std::vector<std::uint32_t>> reauctions;
+  // What the plan was drawn from; the same seed draws the same plan.
+  std::uint64_t seed = 0;
+};
+
+// The accelerated round, then one last round for whatever is still unsold.
+inline constexpr int kReauctionRounds = 2;
+
+// The sets in `sets` order (every set in file order if empty), each shuffled,
+// followed by `reauctions` reshuffles of the lot for the re-auction rounds.
+inline LotPlan plan_lots(const Catalog &catalog,
+                         const std::vector<std::string> &sets,
+                         std::uint64_t seed,
+                         int reauctions = kReauctionRounds) {
+  FastRng rng(seed);
+  auto shuffle = [&](std::vector<std::uint32_t> &lots, std::size_t first) {
+    for (std::size_t i = lots.size(); i > first + 1; --i)
+      std::swap(lots[i - 1], lots[first + rng.below(i - first)]);
+  };
+
+  LotPlan plan;
+  plan.seed = seed;
+  auto add_set = [&](std::string_view set) {
+    const auto &players = catalog.players_in_set(set);
+    std::size_t first = plan.order.size();
+    plan.order.insert(plan.order.end(), players.begin(), players.end());
+    shuffle(plan.order, first);
+  };
+  if (sets.empty()) {
+    for (std::size_t i = 0; i < catalog.sets().size(); ++i)
+      add_set(catalog.sets()[static_cast<std::uint16_t>(i)]);
+  } else {
+    for (const auto &set : sets)
+      add_set(set);
+  }
+
+  plan.reauctions.assign(static_cast<std::size_t>(std::max(0, reauctions)),
+                         plan.order);
+  for (auto &round : plan.reauctions)
+    shuffle(round, 0);
+  return plan;
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "auction.h"
+#include "protocol.h"
+
+// A room's Lot Open announcements, encoded a few lots ahead. A lot's
+// announcement depends only on the plan and the catalog, so opening a lot
+// takes the front entry instead of building it. Lots of a re-auction round
+// are only known once the round before it ends; the window never reaches
+// past the lots queued so far.
+//
+// open() runs under the room lock and only notes which lots the window now
+// lacks; refill() encodes them once the room lock is released, so advancing
+// a lot costs a pop and the broadcast. The queue has its own mutex for the
+// hand-over; a lot that refill() has not reached yet is encoded by open().
+class LotQueue {
+public:
+  static constexpr std::size_t kPrefetch = 4;
+
+  // Drops every prefetched lot, e.g. when the auction restarts.
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ready_.clear();
+    wanted_.clear();
+    ++generation_;
+  }
+
+  // The announcement of auction's open lot (which must exist). Caller must
+  // hold the room lock, and call refill() after releasing it.
+  Frames open(const Auction &auction) {
+    std::size_t lot = auction.lot_number();
+    std::lock_guard<std::mutex> lock(mutex_);
+    while (!ready_.empty() && ready_.front().first < lot)
+      ready_.pop_front();
+    Frames frames;
+    if (!ready_.empty() && ready_.front().first == lot) {
+      frames = std::move(ready_.front().second);
+      ready_.pop_front();
+    } else {
+      frames = announce(auction, lot);
+    }
+
+    catalog_ = &auction.catalog();
+    wanted_.clear();
+    std::size_t next = ready_.empty() ? lot + 1 : ready_.back().first + 1;
+    for (; next <= lot + kPrefetch && next <= auction.lots_queued(); ++next)
+      wanted_.emplace_back(next, auction.player_at(next));
+    due_.store(!wanted_.empty(), std::memory_order_release);
+    return frames;
+  }
+
+  // Encodes the lots the last open() found missing from the window. Call
+  // without the room lock; a no-op when nothing is due.
+  void refill() {
+    if (!due_.exchange(false, std::memory_order_acquire))
+      return;
+    std::vector<std::pair<std::size_t, std::uint32_t>> wanted;
+    const Catalog *catalog;
+    std::uint64_t generation;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      wanted.swap(wanted_);
+      catalog = catalog_;
+      generation = generation_;
+    }
+    std::vector<std::pair<std::size_t, Frames>> encoded;
+    for (const auto &[lot, player] : wanted)
+      encoded.emplace_back(lot, announce(*catalog, lot, player));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // The auction restarted meanwhile: these are lots of the old plan.
+    if (generation != generation_)
+      return;
+    for (auto &entry : encoded) {
+      if (ready_.empty() || entry.first > ready_.back().first)
+        ready_.push_back(std::move(entry));
+    }
+  }
+
+  static Frames announce(const Auction &auction, std::size_t lot) {
+    return announce(auction.catalog(), lot, auction.player_at(lot));
+  }
+
+  static Frames announce(const Catalog &catalog, std::size_t lot,
+                         std::uint32_t player) {
+    return encode(Message(Opcode::LotOpen)
+                      .set(Field::Lot, lot)
+                      .set(Field::Set, catalog.set(player))
+                      .set(Field::Name, catalog.name(player))
+                      .set(Field::Role, catalog.role(player))
+                      .set(Field::BasePrice, catalog.base_price(player))
+                      .set(Field::NextBid, catalog.base_price(player)));
+  }
+
+private:
+  std::mutex mutex_;
+  // (lot number, announcement), in lot order.
+  std::deque<std::pair<std::size_t, Frames>> ready_;
+  // (lot number, player) that refill() is to encode.
+  std::vector<std::pair<std::size_t, std::uint32_t>> wanted_;
+  const Catalog *catalog_ = nullptr;
+  // Bumped by clear(), so a refill() that straddles it is discarded.
+  std::uint64_t generation_ = 0;
+  std::atomic<bool> due_{false};
+};
@@ -1,172 +1,257 @@
 #include <algorithm>
 #include <chrono>
-#include <fstream>
 #include <iomanip>
 #include <iostream>
-#include <random>
-#include <sstream>
+#include <poll.h>
 #include <string>
 #include <thread>
+#include <unistd.h>
 #include <vector>
-struct Player {
-  std::string name;
-  std::string country;
-  std::string role;
-  std::string prev_team;
-  std::string cap_status;
-  float base_price;
-};
-
-std::vector<std::string> read_category_order(const std::string &filename) {
-  std::ifstream env_file(filename);
-  std::string line;
-
-  while (std::getline(env_file, line)) {
-    if (line.rfind("CATEGORY_ORDER=", 0) == 0) {
-      std::string categories = line.substr(15);
-      std::vector<std::string> result;
-      std::stringstream ss(categories);
-      std::string token;
-      while (std::getline(ss, token, ',')) {
-        result.push_back(token);
-      }
-      return result;
-    }
-  }
 
-  return {};
-}
+#include "auction.h"
+#include "results.h"
+#include "simulator.h"
 
-float get_bid_increment(float current_bid) {
-  if (current_bid < 1.0f)
-    return 0.05f;
-  else if (current_bid < 2.0f)
-    return 0.1f;
-  else if (current_bid < 5.0f)
-    return 0.2f;
-  else
-    return 0.25f;
+// Waits for a line on stdin until `deadline`. Returns false if the deadline
+// passes first; at EOF it sleeps out the deadline so lots still time out.
+bool read_line_until(std::string &line,
+                     std::chrono::steady_clock::time_point deadline) {
+  auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       deadline - std::chrono::steady_clock::now())
+                       .count();
+  if (remaining <= 0)
+    return false;
+  pollfd pfd{STDIN_FILENO, POLLIN, 0};
+  if (std::cin.rdbuf()->in_avail() <= 0 &&
+      ::poll(&pfd, 1, static_cast<int>(remaining)) <= 0)
+    return false;
+  if (!std::getline(std::cin, line)) {
+    std::this_thread::sleep_until(deadline);
+    return false;
+  }
+  return true;
 }
 
-std::vector<Player>
-load_players_for_category(const std::string &csv_file,
-                          const std::string &target_category) {
-  std::ifstream file(csv_file);
-  std::vector<Player> players;
-  std::string line;
+// Runs one lot on stdin and appends its outcome to `results`; returns true if
+// the player was sold.
+bool auction_lot(const Catalog &catalog, std::uint32_t p, int number,
+                 ResultsStore &results) {
+  std::cout << number << ". " << catalog.name(p) << " - " << catalog.role(p)
+            << " - ₹" << catalog.base_price(p) << "\n";
+
+  std::string winning_team;
+  std::string input;
+  Money current_bid;
+  std::uint32_t bids = 0;
+  auto last_bid_time = std::chrono::steady_clock::now();
 
-  std::getline(file, line);
+  while (true) {
+    std::cout << "(Enter bidder or 'close'): " << std::flush;
 
-  while (std::getline(file, line)) {
-    std::stringstream ss(line);
-    std::string item;
-    Player p;
-    std::string player_category;
+    // Close as soon as 20 seconds pass without a bid
+    if (!read_line_until(input, last_bid_time + std::chrono::seconds(20))) {
+      std::cout
+          << "\n⏰ Bidding auto-closed after 20 seconds of inactivity.\n";
+      break;
+    }
 
-    std::getline(ss, player_category, ',');
-    if (player_category != target_category)
+    if (input.empty())
       continue;
 
-    std::getline(ss, p.name, ',');
-    std::getline(ss, p.country, ',');
-    std::getline(ss, p.prev_team, ',');
-    std::getline(ss, p.cap_status, ',');
-    std::getline(ss, p.role, ',');
-    std::getline(ss, item, ',');
-    p.base_price = std::stof(item);
+    if (input == "close") {
+      std::cout << "🔒 Bidding manually closed.\n";
+      break;
+    }
 
-    players.push_back(p);
+    std::string bidder = input;
+    if (winning_team.empty()) {
+      // First bidder starts at base price
+      current_bid = catalog.base_price(p);
+    } else {
+      current_bid += get_bid_increment(current_bid);
+    }
+    winning_team = bidder;
+    ++bids;
+    last_bid_time = std::chrono::steady_clock::now();
+
+    std::cout << bidder << " bids ₹" << current_bid << "\n";
   }
 
-  return players;
+  results.append(catalog, ResultsStore::Row{p, winning_team, current_bid,
+                                              bids});
+  if (!winning_team.empty()) {
+    std::cout << "✅ " << catalog.name(p) << " SOLD to " << winning_team
+              << " for ₹" << current_bid << "\n";
+    return true;
+  }
+  std::cout << "❌ " << catalog.name(p) << " UNSOLD" << "\n";
+  return false;
 }
 
-std::string format_price(float price) {
-
-  return price >= 1 ? std::to_string(price) + "Cr"
-                    : std::to_string(price * 100) + "L";
+// One line per group: lots, sales, unsold rate, spend and premium over base.
+void print_results(const ResultsStore &results, const Catalog &catalog,
+                   ResultsStore::GroupBy by) {
+  std::cout << std::left << std::setw(16) << group_by_name(by) << std::right
+            << std::setw(8) << "lots" << std::setw(8) << "sold"
+            << std::setw(10) << "unsold %" << std::setw(12) << "spent Cr"
+            << std::setw(11) << "premium %" << "\n";
+  std::cout << std::fixed << std::setprecision(2);
+  for (const auto &totals : results.totals(by, catalog)) {
+    std::cout << std::left << std::setw(16) << totals.group << std::right
+              << std::setw(8) << totals.lots << std::setw(8) << totals.sold
+              << std::setw(10) << totals.unsold_rate() * 100 << std::setw(12)
+              << static_cast<double>(totals.price_lakhs) / 100
+              << std::setw(11) << totals.premium() * 100 << "\n";
+  }
+  std::cout << std::defaultfloat;
 }
 
 void auction_players_from_csv(const std::string &csv_file,
                               const std::vector<std::string> &category_order) {
-  std::random_device rd;
-  std::mt19937 rng(rd());
-
   int count = 1;
+  Catalog catalog = Catalog::load(csv_file);
+  ResultsStore results;
 
-  for (const auto &category : category_order) {
-    auto players = load_players_for_category(csv_file, category);
-    if (!players.empty()) {
-      std::cout << category << "\n";
-      std::shuffle(players.begin(), players.end(), rng);
-
-      for (const auto &p : players) {
-        std::cout << count++ << ". " << p.name << " - " << p.role << " - ₹"
-                  << format_price(p.base_price) << "\n";
-
-        std::string winning_team;
-        std::string input;
-        float current_bid;
-        auto last_bid_time = std::chrono::steady_clock::now();
-
-        while (true) {
-          std::cout << "(Enter bidder or 'close'): ";
-          std::getline(std::cin, input);
-
-          // Check timer expiry (20 seconds idle)
-          auto now = std::chrono::steady_clock::now();
-          auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(
-                             now - last_bid_time)
-                             .count();
-
-          if (elapsed >= 20) {
-            std::cout
-                << "⏰ Bidding auto-closed after 20 seconds of inactivity.\n";
-            break;
-          }
-
-          if (input.empty()) {
-            std::this_thread::sleep_for(std::chrono::seconds(1));
-            continue;
-          }
-
-          if (input == "close") {
-            std::cout << "🔒 Bidding manually closed.\n";
-            break;
-          }
-
-          std::string bidder = input;
-          if (winning_team.empty()) {
-            // First bidder starts at base price
-            current_bid = p.base_price;
-          } else {
-            float increment = get_bid_increment(current_bid);
-            current_bid += increment;
-          }
-          winning_team = bidder;
-          last_bid_time = std::chrono::steady_clock::now();
-
-          std::cout << bidder << " bids ₹" << format_price(current_bid)
-                    << "Cr\n";
-        }
-
-        if (!winning_team.empty()) {
-          std::cout << "✅ " << p.name << " SOLD to " << winning_team
-                    << " for ₹" << format_price(current_bid) << "Cr\n";
-        } else {
-          std::cout << "❌ " << p.name << " UNSOLD" << "\n";
-        }
+  // The whole order is drawn before the first lot, so no set boundary waits
+  // on a shuffle; each re-auction round then takes the players the round
+  // before it left unsold.
+  LotPlan plan = plan_lots(catalog, category_order, thread_rng()());
+  std::vector<std::uint32_t> lots = plan.order;
+  std::vector<bool> unsold(catalog.size());
+  for (std::size_t round = 0; !lots.empty(); ++round) {
+    if (round > 0)
+      std::cout << "\n"
+                << (round == 1 ? "Accelerated round" : "Unsold round") << "\n";
+    const std::string *set = nullptr;
+    for (std::uint32_t p : lots) {
+      if (round == 0 && (!set || *set != catalog.set(p))) {
+        set = &catalog.set(p);
+        std::cout << *set << "\n";
       }
+      unsold[p] = !auction_lot(catalog, p, count++, results);
+    }
+    if (round == plan.reauctions.size())
+      break;
+    std::vector<std::uint32_t> again;
+    for (std::uint32_t p : plan.reauctions[round]) {
+      if (unsold[p])
+        again.push_back(p);
     }
+    lots = std::move(again);
   }
   std::cout << "\n";
+  print_results(results, catalog, ResultsStore::GroupBy::Team);
+  std::cout << "\n";
+  print_results(results, catalog, ResultsStore::GroupBy::Role);
+}
+
+// Headless mode: runs many synthetic auctions in parallel and prints the
+// totals. See simulator.h. With `keep_results`, every lot also goes into a
+// ResultsStore and each query over it is printed with its time.
+int simulate(const SimConfig &config, const std::string &csv_file,
+             const std::vector<std::string> &category_order,
+             bool keep_results) {
+  Catalog catalog = Catalog::load(csv_file);
+  ResultsStore results;
+
+  auto start = std::chrono::steady_clock::now();
+  SimTotals totals = sim::run(config, catalog, category_order,
+                              keep_results ? &results : nullptr);
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  auto per_auction = [&](double value) {
+    return totals.auctions ? value / static_cast<double>(totals.auctions) : 0;
+  };
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "auctions        " << totals.auctions << " (seed "
+            << config.seed << ", " << config.teams << " teams)\n"
+            << "lots            " << totals.lots << ", " << totals.sold
+            << " sold\n"
+            << "bids            " << totals.bids << ", "
+            << totals.refusals << " times a team was stopped by squad rules\n"
+            << "price / base    "
+            << (totals.base_lakhs
+                    ? static_cast<double>(totals.spent_lakhs) /
+                          static_cast<double>(totals.base_lakhs)
+                    : 0)
+            << "\n"
+            << "auction length  "
+            << per_auction(static_cast<double>(totals.simulated_ms)) / 60000
+            << " simulated minutes\n"
+            << "checksum        " << std::hex << totals.checksum << std::dec
+            << "\n"
+            << "wall time       " << seconds << "s on " << config.threads
+            << " threads, "
+            << (seconds > 0 ? static_cast<double>(totals.bids) / seconds : 0)
+            << " bids/s\n";
+
+  if (!keep_results)
+    return 0;
+  using GroupBy = ResultsStore::GroupBy;
+  for (auto by :
+       {GroupBy::Team, GroupBy::Set, GroupBy::Role, GroupBy::Country}) {
+    std::cout << "\n";
+    auto query_start = std::chrono::steady_clock::now();
+    print_results(results, catalog, by);
+    std::cout << "(" << results.size() << " lots in "
+              << std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - query_start)
+                     .count()
+              << "ms)\n";
+  }
+  return 0;
 }
 
-int main() {
+//   auction                       interactive auctioneer on stdin
+//   auction --simulate [--auctions 1000] [--threads N] [--seed 1]
+//                      [--teams 10] [--purse-crores 120] [--squad-max 25]
+//                      [--timeout-ms 20000] [--think-ms 2500] [--results]
+int main(int argc, char **argv) {
+  // Lets read_line_until see lines already buffered by std::cin
+  std::ios::sync_with_stdio(false);
   std::string csv_file = "Auction_List.csv";
   std::string env_file = ".env";
 
   auto category_order = read_category_order(env_file);
+
+  bool simulation = false;
+  bool keep_results = false;
+  SimConfig config;
+  for (int i = 1; i < argc; ++i) {
+    std::string flag = argv[i];
+    if (flag == "--simulate") {
+      simulation = true;
+      continue;
+    }
+    if (flag == "--results") {
+      keep_results = true;
+      continue;
+    }
+    if (i + 1 >= argc)
+      break;
+    std::string value = argv[++i];
+    if (flag == "--auctions")
+      config.auctions = std::stoul(value);
+    else if (flag == "--threads")
+      config.threads = static_cast<unsigned>(std::stoul(value));
+    else if (flag == "--seed")
+      config.seed = std::stoull(value);
+    else if (flag == "--teams")
+      config.teams = std::stoi(value);
+    else if (flag == "--purse-crores")
+      config.rules.purse = Money::parse_crores(value);
+    else if (flag == "--squad-max")
+      config.rules.max_players = std::stoi(value);
+    else if (flag == "--timeout-ms")
+      config.bid_timeout = std::chrono::milliseconds(std::stol(value));
+    else if (flag == "--think-ms")
+      config.mean_think = std::chrono::milliseconds(std::stol(value));
+  }
+  if (simulation)
+    return simulate(config, csv_file, category_order, keep_results);
+
   auction_players_from_csv(csv_file, category_order);
 
   return 0;
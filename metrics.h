@@ -0,0 +1,192 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Counters and histograms for hot paths. Every thread records into its own
+// shard with relaxed atomics, so recording never contends; a scrape sums the
+// shards. Metrics are registered up front and addressed by the returned id.
+//
+// Histograms use power-of-two buckets: durations in nanoseconds (exported
+// as seconds) or plain counts such as broadcast fan-out.
+class Metrics {
+public:
+  using Id = std::uint32_t;
+  using Clock = std::chrono::steady_clock;
+  static constexpr std::size_t kMaxCounters = 64;
+  static constexpr std::size_t kMaxHistograms = 32;
+  static constexpr std::size_t kBuckets = 40;
+
+  enum class Unit { Seconds, Count };
+
+  // Times a scope into a histogram.
+  class Timer {
+  public:
+    Timer(Metrics &metrics, Id histogram)
+        : metrics_(metrics), histogram_(histogram), start_(Clock::now()) {}
+    ~Timer() { metrics_.observe(histogram_, Clock::now() - start_); }
+    Timer(const Timer &) = delete;
+    Timer &operator=(const Timer &) = delete;
+
+  private:
+    Metrics &metrics_;
+    Id histogram_;
+    Clock::time_point start_;
+  };
+
+  // `labels` is empty or Prometheus label pairs such as type="Place Bid".
+  Id counter(std::string name, std::string help, std::string labels = {}) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    counters_.push_back({std::move(name), std::move(labels), std::move(help),
+                         Unit::Count});
+    return static_cast<Id>(counters_.size() - 1);
+  }
+
+  Id histogram(std::string name, std::string help, Unit unit,
+               std::string labels = {}) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    histograms_.push_back(
+        {std::move(name), std::move(labels), std::move(help), unit});
+    return static_cast<Id>(histograms_.size() - 1);
+  }
+
+  void add(Id counter, std::uint64_t n = 1) {
+    shard().counters[counter].fetch_add(n, std::memory_order_relaxed);
+  }
+
+  void observe(Id histogram, std::uint64_t value) {
+    Bins &bins = shard().histograms[histogram];
+    // Bucket b counts values up to 2^b.
+    std::size_t bucket =
+        value <= 1 ? 0 : 64 - static_cast<std::size_t>(
+                                  __builtin_clzll(value - 1));
+    bucket = std::min(bucket, kBuckets - 1);
+    bins.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    bins.sum.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  void observe(Id histogram, Clock::duration elapsed) {
+    observe(histogram, static_cast<std::uint64_t>(
+                           std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               elapsed)
+                               .count()));
+  }
+
+  std::uint64_t total(Id counter) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::uint64_t sum = 0;
+    for (const auto &shard : shards_)
+      sum += shard->counters[counter].load(std::memory_order_relaxed);
+    return sum;
+  }
+
+  // Prometheus text exposition of every registered metric. `labels`, if
+  // any, are added to every series, e.g. worker="2".
+  void write(std::ostream &out, const std::string &labels = {}) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string last;
+    for (std::size_t id = 0; id < counters_.size(); ++id) {
+      const Info &info = counters_[id];
+      header(out, info, "counter", last);
+      std::string all = join(info.labels, labels);
+      std::uint64_t sum = 0;
+      for (const auto &shard : shards_)
+        sum += shard->counters[id].load(std::memory_order_relaxed);
+      out << info.name << braces(all) << " " << sum << "\n";
+    }
+    for (std::size_t id = 0; id < histograms_.size(); ++id) {
+      const Info &info = histograms_[id];
+      header(out, info, "histogram", last);
+      std::string all = join(info.labels, labels);
+      std::array<std::uint64_t, kBuckets> buckets{};
+      std::uint64_t sum = 0;
+      for (const auto &shard : shards_) {
+        const Bins &bins = shard->histograms[id];
+        for (std::size_t b = 0; b < kBuckets; ++b)
+          buckets[b] += bins.buckets[b].load(std::memory_order_relaxed);
+        sum += bins.sum.load(std::memory_order_relaxed);
+      }
+      double scale = info.unit == Unit::Seconds ? 1e-9 : 1;
+      std::string prefix = all.empty() ? "" : all + ",";
+      std::uint64_t count = 0;
+      for (std::size_t b = 0; b < kBuckets; ++b) {
+        count += buckets[b];
+        if (buckets[b] == 0 && b + 1 < kBuckets)
+          continue;
+        out << info.name << "_bucket{" << prefix << "le=\"";
+        if (b + 1 < kBuckets)
+          out << static_cast<double>(std::uint64_t(1) << b) * scale;
+        else
+          out << "+Inf";
+        out << "\"} " << count << "\n";
+      }
+      out << info.name << "_sum" << braces(all) << " "
+          << static_cast<double>(sum) * scale << "\n";
+      out << info.name << "_count" << braces(all) << " " << count << "\n";
+    }
+  }
+
+private:
+  struct Info {
+    std::string name;
+    std::string labels;
+    std::string help;
+    Unit unit;
+  };
+
+  struct Bins {
+    std::array<std::atomic<std::uint64_t>, kBuckets> buckets{};
+    std::atomic<std::uint64_t> sum{0};
+  };
+
+  struct alignas(64) Shard {
+    std::array<std::atomic<std::uint64_t>, kMaxCounters> counters{};
+    std::array<Bins, kMaxHistograms> histograms{};
+  };
+
+  // Shards live as long as the Metrics object, so a thread that exits keeps
+  // its counts in the totals. The thread-local cache assumes one Metrics per
+  // process.
+  Shard &shard() {
+    thread_local Metrics *owner = nullptr;
+    thread_local Shard *local = nullptr;
+    if (owner != this) {
+      auto shard = std::make_unique<Shard>();
+      local = shard.get();
+      owner = this;
+      std::lock_guard<std::mutex> lock(mutex_);
+      shards_.push_back(std::move(shard));
+    }
+    return *local;
+  }
+
+  static std::string join(const std::string &a, const std::string &b) {
+    return a.empty() || b.empty() ? a + b : a + "," + b;
+  }
+
+  static std::string braces(const std::string &labels) {
+    return labels.empty() ? "" : "{" + labels + "}";
+  }
+
+  // HELP/TYPE once per metric family; labelled series share a name.
+  static void header(std::ostream &out, const Info &info, const char *type,
+                     std::string &last) {
+    if (info.name == last)
+      return;
+    last = info.name;
+    out << "# HELP " << info.name << " " << info.help << "\n"
+        << "# TYPE " << info.name << " " << type << "\n";
+  }
+
+  mutable std::mutex mutex_;
+  std::vector<Info> counters_;
+  std::vector<Info> histograms_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+};
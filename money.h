@@ -0,0 +1,165 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// An auction amount held as a whole number of lakhs (100 lakhs = 1 crore),
+// so bid arithmetic and comparisons are exact.
+class Money {
+public:
+  // Longest output of format(): "-21474836.47Cr".
+  static constexpr std::size_t kFormatSize = 16;
+
+  constexpr Money() = default;
+  static constexpr Money lakhs(std::int32_t value) { return Money(value); }
+  static constexpr Money max() {
+    return Money(std::numeric_limits<std::int32_t>::max());
+  }
+  // Rounds to the nearest lakh, e.g. a bid amount read from JSON.
+  static Money from_crores(double crores) {
+    return Money(static_cast<std::int32_t>(std::llround(crores * 100)));
+  }
+
+  // Parses a decimal crore amount such as "2", "0.3" or "1.25". Digits past
+  // the second decimal place round the last lakh.
+  static constexpr Money parse_crores(std::string_view text) {
+    std::int32_t whole = 0;
+    std::int32_t fraction = 0;
+    int decimals = -1;
+    bool round_up = false;
+    for (char c : text) {
+      if (c == '.' && decimals < 0) {
+        decimals = 0;
+      } else if (c >= '0' && c <= '9') {
+        if (decimals < 0)
+          whole = whole * 10 + (c - '0');
+        else if (decimals++ < 2)
+          fraction = fraction * 10 + (c - '0');
+        else if (decimals == 3)
+          round_up = c >= '5';
+      }
+    }
+    for (; decimals < 2; ++decimals)
+      fraction *= 10;
+    return Money(whole * 100 + fraction + (round_up ? 1 : 0));
+  }
+
+  constexpr std::int32_t lakhs() const { return lakhs_; }
+  constexpr double crores() const { return lakhs_ / 100.0; }
+
+  constexpr Money operator+(Money other) const {
+    return Money(lakhs_ + other.lakhs_);
+  }
+  constexpr Money operator-(Money other) const {
+    return Money(lakhs_ - other.lakhs_);
+  }
+  constexpr Money &operator+=(Money other) {
+    lakhs_ += other.lakhs_;
+    return *this;
+  }
+  constexpr Money &operator-=(Money other) {
+    lakhs_ -= other.lakhs_;
+    return *this;
+  }
+  constexpr bool operator==(Money other) const {
+    return lakhs_ == other.lakhs_;
+  }
+  constexpr bool operator!=(Money other) const {
+    return lakhs_ != other.lakhs_;
+  }
+  constexpr bool operator<(Money other) const { return lakhs_ < other.lakhs_; }
+  constexpr bool operator<=(Money other) const {
+    return lakhs_ <= other.lakhs_;
+  }
+  constexpr bool operator>(Money other) const { return lakhs_ > other.lakhs_; }
+  constexpr bool operator>=(Money other) const {
+    return lakhs_ >= other.lakhs_;
+  }
+
+  // Writes "2Cr", "2.2Cr", "1.25Cr" or "75L" into buf (at least kFormatSize
+  // chars, not NUL-terminated) and returns the written text.
+  std::string_view format(char *buf) const {
+    char *out = buf;
+    std::int64_t value = lakhs_;
+    if (value < 0) {
+      *out++ = '-';
+      value = -value;
+    }
+    if (value < 100) {
+      out = write_digits(out, value);
+      *out++ = 'L';
+      return std::string_view(buf, out - buf);
+    }
+    out = write_digits(out, value / 100);
+    int fraction = static_cast<int>(value % 100);
+    if (fraction) {
+      *out++ = '.';
+      *out++ = static_cast<char>('0' + fraction / 10);
+      if (fraction % 10)
+        *out++ = static_cast<char>('0' + fraction % 10);
+    }
+    *out++ = 'C';
+    *out++ = 'r';
+    return std::string_view(buf, out - buf);
+  }
+
+  std::string str() const {
+    char buf[kFormatSize];
+    return std::string(format(buf));
+  }
+
+private:
+  constexpr explicit Money(std::int32_t lakhs) : lakhs_(lakhs) {}
+
+  static char *write_digits(char *out, std::int64_t value) {
+    char digits[12];
+    int n = 0;
+    do {
+      digits[n++] = static_cast<char>('0' + value % 10);
+      value /= 10;
+    } while (value);
+    while (n)
+      *out++ = digits[--n];
+    return out;
+  }
+
+  std::int32_t lakhs_ = 0;
+};
+
+inline std::ostream &operator<<(std::ostream &os, Money money) {
+  char buf[Money::kFormatSize];
+  return os << money.format(buf);
+}
+
+// The bid ladder: each step applies while the current bid is below `below`.
+struct IncrementStep {
+  Money below;
+  Money step;
+};
+
+inline constexpr IncrementStep kBidIncrements[] = {
+    {Money::lakhs(100), Money::lakhs(5)},
+    {Money::lakhs(200), Money::lakhs(10)},
+    {Money::lakhs(500), Money::lakhs(20)},
+    {Money::max(), Money::lakhs(25)},
+};
+
+constexpr Money get_bid_increment(Money current_bid) {
+  for (const auto &rung : kBidIncrements) {
+    if (current_bid < rung.below)
+      return rung.step;
+  }
+  return kBidIncrements[std::size(kBidIncrements) - 1].step;
+}
+
+static_assert(get_bid_increment(Money::lakhs(30)) == Money::lakhs(5));
+static_assert(get_bid_increment(Money::lakhs(100)) == Money::lakhs(10));
+static_assert(get_bid_increment(Money::lakhs(480)) == Money::lakhs(20));
+static_assert(get_bid_increment(Money::lakhs(1500)) == Money::lakhs(25));
+static_assert(Money::parse_crores("1.25") == Money::lakhs(125));
+static_assert(Money::parse_crores("0.3") == Money::lakhs(30));
+static_assert(Money::parse_crores("2") == Money::lakhs(200));
@@ -0,0 +1,331 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "protocol.h"
+
+// Process-wide outbound queue counters, summed over every Outbox.
+struct OutboxMetrics {
+  std::atomic<std::int64_t> queued_frames{0};
+  std::atomic<std::int64_t> queued_bytes{0};
+  std::atomic<std::uint64_t> sent_frames{0};
+  std::atomic<std::uint64_t> coalesced{0};
+  std::atomic<std::uint64_t> dropped{0};
+  std::atomic<std::uint64_t> evictions{0};
+  // Flushes that left frames queued because the window was full.
+  std::atomic<std::uint64_t> paced{0};
+};
+
+inline OutboxMetrics outboxMetrics;
+
+template <typename Connection> class OutboxPacer;
+
+// A bounded queue of frames waiting to be written to one connection. Rooms
+// push into it while holding their lock; flush() does the actual sends later,
+// outside any room lock, so a slow socket never stalls the fan-out.
+//
+// Frames pushed with a coalescing key replace a still-queued frame with the
+// same key, so a client that falls behind only gets the latest of a run of
+// state updates. A client whose queue stays past kMaxFrames or
+// kHighWaterBytes for kBacklogGrace, or ever grows kBurstFactor times past
+// them, is evicted: its queue is dropped and the connection closed on the
+// next flush. A burst such as a roster catch-up can thus go over the marks
+// for a while without costing the client its connection.
+//
+// Crow copies each frame into its own unbounded write buffer and exposes
+// neither that buffer nor the socket, so nothing here sees what was really
+// written. An outbox with a pacer only hands Crow a window of kWindowBytes
+// at a time and counts it as written at the pacer's drain rate; once the
+// window is full the rest stays queued here, where it coalesces and counts
+// toward eviction, and the pacer flushes again as the window frees up.
+// This bounds what a room sends faster than the drain rate. It does not
+// cover a congested link: a client that reads slower than the drain rate
+// still grows Crow's buffer by the difference. Set the rate to what the
+// slowest client worth keeping sustains.
+template <typename Connection>
+class Outbox : public std::enable_shared_from_this<Outbox<Connection>> {
+public:
+  static constexpr std::size_t kMaxFrames = 512;
+  static constexpr std::size_t kHighWaterBytes = 1 << 20;
+  static constexpr std::size_t kBurstFactor = 8;
+  static constexpr auto kBacklogGrace = std::chrono::seconds(5);
+  static constexpr std::size_t kWindowBytes = 256 << 10;
+
+  // Without a pacer every flush hands Crow all that is queued.
+  Outbox(Connection *conn, bool binary,
+         OutboxPacer<Connection> *pacer = nullptr)
+      : conn_(conn), binary_(binary), pacer_(pacer) {}
+  ~Outbox() { discard(); }
+  Outbox(const Outbox &) = delete;
+  Outbox &operator=(const Outbox &) = delete;
+
+  bool binary() const { return binary_; }
+
+  // Queues the frame in this connection's format. Returns true when the
+  // outbox was idle, i.e. the caller must arrange for flush() to run.
+  bool push(const Frames &frames, std::uint64_t coalesce_key = 0) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return push_locked(frames, coalesce_key);
+  }
+
+  // Queues a last frame; the flush that writes it then closes the
+  // connection with `reason`. Returns true as push() does.
+  bool finish(const Frames &frames, std::string reason) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    finish_reason_ = std::move(reason);
+    finishing_ = true;
+    return push_locked(frames, 0);
+  }
+
+  // Writes what the window allows of the queue, or closes an evicted
+  // connection. Anything left is handed to the pacer to flush later.
+  void flush() {
+    std::lock_guard<std::recursive_mutex> sending(send_mutex_);
+    std::deque<Item> batch;
+    bool evict;
+    bool backlog = false;
+    bool finish = false;
+    std::string reason;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      scheduled_ = false;
+      if (closed_)
+        return;
+      evict = evicted_;
+      if (evict) {
+        closed_ = true;
+      } else if (!pacer_) {
+        batch.swap(queue_);
+        adjust(-static_cast<std::int64_t>(batch.size()),
+               -static_cast<std::int64_t>(bytes_));
+        bytes_ = 0;
+      } else {
+        drain_window();
+        std::size_t sent = 0;
+        // An empty window always takes one frame, however large.
+        while (!queue_.empty() &&
+               (in_flight_ == 0 ||
+                in_flight_ + queue_.front().frame->size() <= kWindowBytes)) {
+          std::size_t size = queue_.front().frame->size();
+          in_flight_ += size;
+          sent += size;
+          batch.push_back(std::move(queue_.front()));
+          queue_.pop_front();
+        }
+        bytes_ -= sent;
+        adjust(-static_cast<std::int64_t>(batch.size()),
+               -static_cast<std::int64_t>(sent));
+        backlog = !queue_.empty();
+        if (queue_.size() <= kMaxFrames && bytes_ <= kHighWaterBytes)
+          backlogged_ = false;
+        // Pushes leave a backlog to the pacer rather than flush it early.
+        scheduled_ = backlog;
+      }
+      finish = !evict && finishing_ && queue_.empty();
+      if (finish) {
+        closed_ = true;
+        reason = finish_reason_;
+      }
+    }
+    if (evict) {
+      conn_->close("Connection too slow");
+      return;
+    }
+    for (const auto &item : batch) {
+      if (binary_)
+        conn_->send_binary(*item.frame);
+      else
+        conn_->send_text(*item.frame);
+    }
+    outboxMetrics.sent_frames.fetch_add(batch.size(),
+                                        std::memory_order_relaxed);
+    if (finish)
+      conn_->close(reason);
+    if (backlog) {
+      outboxMetrics.paced.fetch_add(1, std::memory_order_relaxed);
+      pacer_->schedule(this->shared_from_this());
+    }
+  }
+
+  // Called when the connection closes. Waits out a flush in progress, after
+  // which the connection is never touched again.
+  void close() {
+    std::lock_guard<std::recursive_mutex> sending(send_mutex_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    discard_locked();
+  }
+
+private:
+  struct Item {
+    Frame frame;
+    std::uint64_t key;
+  };
+
+  bool push_locked(const Frames &frames, std::uint64_t coalesce_key) {
+    const Frame &frame = binary_ ? frames.binary : frames.json;
+    if (closed_ || evicted_) {
+      outboxMetrics.dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    if (coalesce_key) {
+      for (auto &item : queue_) {
+        if (item.key == coalesce_key) {
+          adjust(0, static_cast<std::int64_t>(frame->size()) -
+                        static_cast<std::int64_t>(item.frame->size()));
+          bytes_ += frame->size() - item.frame->size();
+          item.frame = frame;
+          outboxMetrics.coalesced.fetch_add(1, std::memory_order_relaxed);
+          return false;
+        }
+      }
+    }
+    queue_.push_back(Item{frame, coalesce_key});
+    bytes_ += frame->size();
+    adjust(1, static_cast<std::int64_t>(frame->size()));
+    if (queue_.size() > kMaxFrames || bytes_ > kHighWaterBytes) {
+      auto now = std::chrono::steady_clock::now();
+      if (!backlogged_) {
+        backlogged_ = true;
+        backlog_since_ = now;
+      }
+      if (queue_.size() > kMaxFrames * kBurstFactor ||
+          bytes_ > kHighWaterBytes * kBurstFactor ||
+          now - backlog_since_ >= kBacklogGrace) {
+        evicted_ = true;
+        outboxMetrics.evictions.fetch_add(1, std::memory_order_relaxed);
+        outboxMetrics.dropped.fetch_add(queue_.size(),
+                                        std::memory_order_relaxed);
+        discard_locked();
+      }
+    }
+    bool idle = !scheduled_;
+    scheduled_ = true;
+    return idle;
+  }
+
+  static void adjust(std::int64_t frames, std::int64_t bytes) {
+    outboxMetrics.queued_frames.fetch_add(frames, std::memory_order_relaxed);
+    outboxMetrics.queued_bytes.fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  // Counts what Crow has had time to write since the last flush.
+  void drain_window() {
+    auto now = std::chrono::steady_clock::now();
+    auto drained = static_cast<std::size_t>(
+        std::chrono::duration<double>(now - drained_at_).count() *
+        static_cast<double>(pacer_->drain_rate()));
+    in_flight_ -= std::min(in_flight_, drained);
+    drained_at_ = now;
+  }
+
+  void discard() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    discard_locked();
+  }
+
+  void discard_locked() {
+    adjust(-static_cast<std::int64_t>(queue_.size()),
+           -static_cast<std::int64_t>(bytes_));
+    queue_.clear();
+    bytes_ = 0;
+  }
+
+  Connection *conn_;
+  bool binary_;
+  OutboxPacer<Connection> *pacer_;
+  std::mutex mutex_;
+  // Held across sends so close() can wait until the connection is idle.
+  // Recursive because Crow may run the close handler inline from
+  // connection::close() on the same thread.
+  std::recursive_mutex send_mutex_;
+  std::deque<Item> queue_;
+  std::size_t bytes_ = 0;
+  std::size_t in_flight_ = 0;
+  std::chrono::steady_clock::time_point drained_at_ =
+      std::chrono::steady_clock::now();
+  // Over kMaxFrames or kHighWaterBytes, since backlog_since_.
+  bool backlogged_ = false;
+  std::chrono::steady_clock::time_point backlog_since_;
+  bool scheduled_ = false;
+  bool evicted_ = false;
+  bool closed_ = false;
+  // Set by finish(): close once the queue is written.
+  bool finishing_ = false;
+  std::string finish_reason_;
+};
+
+// Flushes outboxes whose window was full again once a tick, from one
+// thread, until their backlog is gone or the connection closes.
+template <typename Connection> class OutboxPacer {
+public:
+  using OutboxPtr = std::shared_ptr<Outbox<Connection>>;
+
+  static constexpr std::size_t kDefaultDrainRate = 512 << 10;
+
+  OutboxPacer() = default;
+  ~OutboxPacer() { stop(); }
+  OutboxPacer(const OutboxPacer &) = delete;
+  OutboxPacer &operator=(const OutboxPacer &) = delete;
+
+  // `drain_rate` is the bytes per second a window handed to a connection
+  // counts as written; see Outbox. Set before any outbox uses the pacer.
+  void start(std::chrono::milliseconds tick,
+             std::size_t drain_rate = kDefaultDrainRate) {
+    tick_ = tick;
+    drain_rate_ = std::max<std::size_t>(drain_rate, 1);
+    thread_ = std::thread([this] { run(); });
+  }
+
+  std::size_t drain_rate() const { return drain_rate_; }
+
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopping_ || !thread_.joinable())
+        return;
+      stopping_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+  }
+
+  // Called by Outbox::flush() when it leaves frames queued.
+  void schedule(OutboxPtr outbox) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    due_.push_back(std::move(outbox));
+  }
+
+private:
+  void run() {
+    std::vector<OutboxPtr> due;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+      wake_.wait_for(lock, tick_, [this] { return stopping_; });
+      due.swap(due_);
+      lock.unlock();
+      // A flush that still cannot empty its queue schedules itself again.
+      for (auto &outbox : due)
+        outbox->flush();
+      due.clear();
+      lock.lock();
+    }
+  }
+
+  std::chrono::milliseconds tick_{10};
+  std::size_t drain_rate_ = kDefaultDrainRate;
+  std::vector<OutboxPtr> due_;
+  bool stopping_ = false;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::thread thread_;
+};
@@ -0,0 +1,138 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+enum class Role : std::uint8_t { Player, Leader };
+
+inline const char *role_name(Role role) {
+  return role == Role::Leader ? "leader" : "player";
+}
+
+inline Role role_for(std::string_view name) {
+  return name == "leader" ? Role::Leader : Role::Player;
+}
+
+struct Player {
+  std::pmr::string username;
+  // Interned by the room (Auction::intern_team); compares by value.
+  std::string_view team;
+  Role role = Role::Player;
+};
+
+// A room's players, each stored once in a slot addressed by a stable integer
+// id, with a username index and a connection index over the slots. A player
+// keeps one slot across reconnects and may hold several connections (tabs).
+// Slots freed by remove() are handed to the next new player.
+//
+// Everything is allocated from the memory resource passed in, normally the
+// room's arena. The username index points into the players' own strings, so
+// looking a player up never allocates.
+//
+// Not thread-safe: the owning room's lock serializes calls.
+template <typename Connection> class PlayerTable {
+public:
+  using Slot = std::uint32_t;
+  static constexpr Slot kNoSlot = ~Slot(0);
+
+  explicit PlayerTable(
+      std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : players_(resource), by_username_(resource), by_connection_(resource),
+        attached_(resource), free_(resource) {}
+
+  // Returns kNoSlot if no player has that username.
+  Slot find(std::string_view username) const {
+    auto it = by_username_.find(username);
+    return it == by_username_.end() ? kNoSlot : it->second;
+  }
+
+  // The slot of an existing player with this username, or a new one.
+  Slot join(std::string_view username, std::string_view team, Role role) {
+    Slot slot = find(username);
+    if (slot != kNoSlot)
+      return slot;
+    if (free_.empty()) {
+      slot = size();
+      players_.push_back(Player{
+          std::pmr::string(username, players_.get_allocator()), team, role});
+      attached_.push_back(0);
+    } else {
+      slot = free_.back();
+      free_.pop_back();
+      Player &player = players_[slot];
+      player.username.assign(username);
+      player.team = team;
+      player.role = role;
+    }
+    by_username_.emplace(players_[slot].username, slot);
+    return slot;
+  }
+
+  void attach(Slot slot, Connection *conn) {
+    if (by_connection_.try_emplace(conn, slot).second)
+      ++attached_[slot];
+  }
+  void detach(Connection *conn) {
+    auto it = by_connection_.find(conn);
+    if (it == by_connection_.end())
+      return;
+    --attached_[it->second];
+    by_connection_.erase(it);
+  }
+
+  // True while the player has at least one connection attached.
+  bool online(Slot slot) const { return attached_[slot] != 0; }
+
+  // Drops an offline player and frees the slot for reuse.
+  void remove(Slot slot) {
+    Player &player = players_[slot];
+    by_username_.erase(player.username);
+    player.username.clear();
+    player.team = {};
+    free_.push_back(slot);
+  }
+
+  // True for a slot freed by remove() and not yet reused.
+  bool vacant(Slot slot) const {
+    auto it = by_username_.find(players_[slot].username);
+    return it == by_username_.end() || it->second != slot;
+  }
+
+  // Fails if another player already has newUsername.
+  bool rename(Slot slot, std::string_view newUsername) {
+    Player &player = players_[slot];
+    if (player.username == newUsername)
+      return true;
+    if (by_username_.count(newUsername))
+      return false;
+    by_username_.erase(player.username);
+    player.username.assign(newUsername);
+    by_username_.emplace(player.username, slot);
+    return true;
+  }
+
+  Player &operator[](Slot slot) { return players_[slot]; }
+  const Player &operator[](Slot slot) const { return players_[slot]; }
+  // Number of slots, vacant ones included.
+  Slot size() const { return static_cast<Slot>(players_.size()); }
+  // Number of players.
+  Slot count() const { return static_cast<Slot>(by_username_.size()); }
+
+  // Attached connections and the slot each belongs to.
+  const std::pmr::unordered_map<Connection *, Slot> &connections() const {
+    return by_connection_;
+  }
+
+private:
+  // A deque so that growing it never moves a username the index points at.
+  std::pmr::deque<Player> players_;
+  std::pmr::unordered_map<std::string_view, Slot> by_username_;
+  std::pmr::unordered_map<Connection *, Slot> by_connection_;
+  // Connections attached to each slot.
+  std::pmr::vector<std::uint32_t> attached_;
+  std::pmr::vector<Slot> free_;
+};
@@ -0,0 +1,403 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "money.h"
+
+// Room messages have one schema and two encodings. JSON text frames carry
+// {"type": "<name>", ...} for browsers and debugging; binary frames carry the
+// numeric opcode followed by varint-tagged fields:
+//
+//   frame  := opcode:u8 field*
+//   field  := key:varint value
+//   key    := field_id << 3 | wire   (wire 0 = zigzag varint, 2 = bytes)
+//   value  := varint | length:varint bytes
+//
+// Amounts are whole lakhs on the wire in binary and crores in JSON. List
+// entries are nested field sequences: a JSON array under "list", or one
+// length-delimited List field per entry in binary.
+enum class Opcode : std::uint8_t {
+  Unknown = 0,
+  // client -> server
+  ChangeUsername = 1,
+  ChangeTeam = 2,
+  StartAuction = 3,
+  PlaceBid = 4,
+  CloseLot = 5,
+  // server -> client
+  YourTeam = 32,
+  YourUsername = 33,
+  NewPlayer = 34,
+  UsernameChange = 35,
+  TeamChange = 36,
+  LotOpen = 37,
+  BidAccepted = 38,
+  BidRejected = 39,
+  LotClosed = 40,
+  AuctionComplete = 41,
+  Error = 42,
+  PlayerList = 43,
+  PlayerLeft = 44,
+};
+
+enum class Field : std::uint8_t {
+  Username = 1,
+  Team = 2,
+  Role = 3,
+  OldUsername = 4,
+  NewUsername = 5,
+  NewTeam = 6,
+  Amount = 7,
+  NextBid = 8,
+  BasePrice = 9,
+  Ref = 10,
+  Lot = 11,
+  Name = 12,
+  Set = 13,
+  Reason = 14,
+  Result = 15,
+  Bids = 16,
+  ClosedBy = 17,
+  Message = 18,
+  Version = 19,
+  List = 20,
+  MaxBid = 21,
+};
+
+namespace protocol {
+
+struct OpcodeName {
+  Opcode op;
+  const char *name;
+};
+
+inline constexpr OpcodeName kOpcodeNames[] = {
+    {Opcode::ChangeUsername, "Change Username"},
+    {Opcode::ChangeTeam, "Change Team"},
+    {Opcode::StartAuction, "Start Auction"},
+    {Opcode::PlaceBid, "Place Bid"},
+    {Opcode::CloseLot, "Close Lot"},
+    {Opcode::YourTeam, "Your Team"},
+    {Opcode::YourUsername, "Your Username"},
+    {Opcode::NewPlayer, "New Player"},
+    {Opcode::UsernameChange, "Username Change"},
+    {Opcode::TeamChange, "Team Change"},
+    {Opcode::LotOpen, "Lot Open"},
+    {Opcode::BidAccepted, "Bid Accepted"},
+    {Opcode::BidRejected, "Bid Rejected"},
+    {Opcode::LotClosed, "Lot Closed"},
+    {Opcode::AuctionComplete, "Auction Complete"},
+    {Opcode::Error, "Error"},
+    {Opcode::PlayerList, "Player List"},
+    {Opcode::PlayerLeft, "Player Left"},
+};
+
+enum class Kind : std::uint8_t { Text, Int, Money };
+
+struct FieldInfo {
+  const char *name;
+  Kind kind;
+};
+
+// Indexed by Field.
+inline constexpr FieldInfo kFields[] = {
+    {"", Kind::Int},
+    {"username", Kind::Text},
+    {"team", Kind::Text},
+    {"role", Kind::Text},
+    {"oldUsername", Kind::Text},
+    {"newUsername", Kind::Text},
+    {"newTeam", Kind::Text},
+    {"amount", Kind::Money},
+    {"nextBid", Kind::Money},
+    {"basePrice", Kind::Money},
+    {"ref", Kind::Int},
+    {"lot", Kind::Int},
+    {"name", Kind::Text},
+    {"set", Kind::Text},
+    {"reason", Kind::Text},
+    {"result", Kind::Text},
+    {"bids", Kind::Int},
+    {"closedBy", Kind::Text},
+    {"message", Kind::Text},
+    {"version", Kind::Int},
+    {"list", Kind::Text},
+    {"maxBid", Kind::Money},
+};
+
+inline const FieldInfo &info(Field field) {
+  return kFields[static_cast<std::size_t>(field)];
+}
+
+inline const char *opcode_name(Opcode op) {
+  for (const auto &entry : kOpcodeNames) {
+    if (entry.op == op)
+      return entry.name;
+  }
+  return "";
+}
+
+inline Opcode opcode_for(std::string_view name) {
+  for (const auto &entry : kOpcodeNames) {
+    if (name == entry.name)
+      return entry.op;
+  }
+  return Opcode::Unknown;
+}
+
+inline void put_varint(std::string &out, std::uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+inline bool get_varint(std::string_view &in, std::uint64_t &value) {
+  value = 0;
+  for (int shift = 0; shift < 64 && !in.empty(); shift += 7) {
+    auto byte = static_cast<std::uint8_t>(in.front());
+    in.remove_prefix(1);
+    value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+inline std::uint64_t zigzag(std::int64_t value) {
+  return (static_cast<std::uint64_t>(value) << 1) ^
+         static_cast<std::uint64_t>(value >> 63);
+}
+
+inline std::int64_t unzigzag(std::uint64_t value) {
+  return static_cast<std::int64_t>(value >> 1) ^
+         -static_cast<std::int64_t>(value & 1);
+}
+
+inline void put_json_string(std::string &out, std::string_view text) {
+  static const char hex[] = "0123456789abcdef";
+  out.push_back('"');
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      out.push_back('\\');
+      out.push_back(c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      out.append("\\u00");
+      out.push_back(hex[(c >> 4) & 0xf]);
+      out.push_back(hex[c & 0xf]);
+    } else {
+      out.push_back(c);
+    }
+  }
+  out.push_back('"');
+}
+
+} // namespace protocol
+
+// One list entry serialized in both encodings, so a list can be reassembled
+// from cached entries without re-encoding them.
+struct ListItem {
+  std::string json;
+  std::string binary;
+};
+
+// An outbound room event, built once and encoded per connection format.
+class Message {
+public:
+  // Room events carry a handful of fields; reserving them up front saves the
+  // vector's growth steps on every message.
+  static constexpr std::size_t kTypicalFields = 8;
+
+  explicit Message(Opcode op) : op_(op) { values_.reserve(kTypicalFields); }
+
+  Message &set(Field field, std::string_view text) {
+    values_.push_back(Value{field, 0, std::string(text)});
+    return *this;
+  }
+  Message &set(Field field, std::int64_t number) {
+    values_.push_back(Value{field, number, {}});
+    return *this;
+  }
+  Message &set(Field field, Money amount) {
+    return set(field, static_cast<std::int64_t>(amount.lakhs()));
+  }
+
+  // Appends a pre-encoded entry to the message's list.
+  Message &add(const ListItem &item) {
+    if (items_)
+      list_json_.push_back(',');
+    list_json_.append(item.json);
+    list_binary_.append(item.binary);
+    ++items_;
+    return *this;
+  }
+
+  Opcode op() const { return op_; }
+
+  std::string json() const {
+    std::string out;
+    out.reserve(128 + list_json_.size());
+    out.append("{\"type\":");
+    protocol::put_json_string(out, protocol::opcode_name(op_));
+    out.push_back(',');
+    append_json_fields(out);
+    // A Player List carries its list even when the room is empty.
+    if (items_ || op_ == Opcode::PlayerList) {
+      out.append("\"list\":[");
+      out.append(list_json_);
+      out.append("],");
+    }
+    out.back() = '}';
+    return out;
+  }
+
+  std::string binary() const {
+    std::string out;
+    out.reserve(64 + list_binary_.size());
+    out.push_back(static_cast<char>(op_));
+    append_binary_fields(out);
+    out.append(list_binary_);
+    return out;
+  }
+
+  // Encodes this message's fields as a list entry for another message.
+  ListItem item() const {
+    ListItem item;
+    item.json.push_back('{');
+    append_json_fields(item.json);
+    if (item.json.size() > 1)
+      item.json.back() = '}';
+    else
+      item.json.push_back('}');
+
+    std::string fields;
+    append_binary_fields(fields);
+    protocol::put_varint(item.binary,
+                         static_cast<std::uint64_t>(Field::List) << 3 | 2);
+    protocol::put_varint(item.binary, fields.size());
+    item.binary.append(fields);
+    return item;
+  }
+
+private:
+  struct Value {
+    Field field;
+    std::int64_t number;
+    std::string text;
+  };
+
+  // Writes `"name":value,` for every field.
+  void append_json_fields(std::string &out) const {
+    for (const auto &value : values_) {
+      const auto &field = protocol::info(value.field);
+      protocol::put_json_string(out, field.name);
+      out.push_back(':');
+      switch (field.kind) {
+      case protocol::Kind::Text:
+        protocol::put_json_string(out, value.text);
+        break;
+      case protocol::Kind::Int:
+        out.append(std::to_string(value.number));
+        break;
+      case protocol::Kind::Money: {
+        // Crores as a plain JSON number, e.g. 2.25 or 0.3.
+        std::int64_t lakhs = value.number;
+        if (lakhs < 0) {
+          out.push_back('-');
+          lakhs = -lakhs;
+        }
+        out.append(std::to_string(lakhs / 100));
+        if (lakhs % 100) {
+          out.push_back('.');
+          out.push_back(static_cast<char>('0' + lakhs % 100 / 10));
+          if (lakhs % 10)
+            out.push_back(static_cast<char>('0' + lakhs % 10));
+        }
+        break;
+      }
+      }
+      out.push_back(',');
+    }
+  }
+
+  void append_binary_fields(std::string &out) const {
+    for (const auto &value : values_) {
+      auto id = static_cast<std::uint64_t>(value.field);
+      if (protocol::info(value.field).kind == protocol::Kind::Text) {
+        protocol::put_varint(out, id << 3 | 2);
+        protocol::put_varint(out, value.text.size());
+        out.append(value.text);
+      } else {
+        protocol::put_varint(out, id << 3);
+        protocol::put_varint(out, protocol::zigzag(value.number));
+      }
+    }
+  }
+
+  Opcode op_;
+  std::vector<Value> values_;
+  std::string list_json_;
+  std::string list_binary_;
+  std::size_t items_ = 0;
+};
+
+// A serialized message shared by every recipient of a broadcast.
+using Frame = std::shared_ptr<const std::string>;
+
+// A message encoded once in each wire format.
+struct Frames {
+  Frame json;
+  Frame binary;
+
+  const std::string &get(bool binary_format) const {
+    return binary_format ? *binary : *json;
+  }
+};
+
+inline Frames encode(const Message &msg) {
+  return Frames{std::make_shared<const std::string>(msg.json()),
+                std::make_shared<const std::string>(msg.binary())};
+}
+
+// A decoded client request. `text` holds the new username or team.
+struct Command {
+  Opcode op = Opcode::Unknown;
+  std::string text;
+  Money amount;
+  bool has_amount = false;
+  std::int64_t ref = 0;
+};
+
+// Decodes a binary client frame; unknown fields are skipped.
+inline bool decode_command(std::string_view frame, Command &cmd) {
+  if (frame.empty())
+    return false;
+  cmd.op = static_cast<Opcode>(frame.front());
+  frame.remove_prefix(1);
+  while (!frame.empty()) {
+    std::uint64_t key;
+    std::uint64_t value;
+    if (!protocol::get_varint(frame, key) ||
+        !protocol::get_varint(frame, value))
+      return false;
+    auto field = static_cast<Field>(key >> 3);
+    if ((key & 7) == 2) {
+      if (value > frame.size())
+        return false;
+      if (field == Field::NewUsername || field == Field::NewTeam)
+        cmd.text.assign(frame.data(), value);
+      frame.remove_prefix(value);
+    } else if (field == Field::Amount) {
+      cmd.amount = Money::lakhs(
+          static_cast<std::int32_t>(protocol::unzigzag(value)));
+      cmd.has_amount = true;
+    } else if (field == Field::Ref) {
+      cmd.ref = protocol::unzigzag(value);
+    }
+  }
+  return true;
+}
@@ -0,0 +1,443 @@
+// Replay-driven load tool for server.cpp.
+//
+//   g++ -O2 -std=c++17 -pthread replay.cpp -o replay
+//   ./replay --generate [--clients 50] [--teams 8] [--lots 10]
+//            [--bids-per-lot 40] [--bid-gap-ms 5] [--seed 1] > traffic.txt
+//   ./replay --script traffic.txt [--host 127.0.0.1] [--port 18080]
+//            [--server-pid PID] [--json result.json]
+//            [--baseline old.json] [--tolerance 0.10]
+//
+// A script has one message per line: "<at_ms> <client> <json>", in time
+// order; '#' starts a comment. Client 0 is the room leader from
+// /create-room, clients 1..N join through /join-room/<id>, and N is the
+// highest client index used. In the json, {{nextBid}} becomes the latest
+// nextBid the sending client has seen and {{ref}} a unique number, so
+// recorded traffic can be replayed against a fresh room.
+//
+// Fan-out latency runs from sending a message to each other client
+// receiving the broadcast it caused (Bid Accepted by ref, Username Change by
+// new name, Team Change by username and team). Results print as text and,
+// with --json, as one flat JSON object. With --baseline the run fails (exit
+// 1) when p99 latency or delivery throughput is worse than the baseline's
+// by more than the tolerance.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "ws_client.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  Endpoint server;
+  std::string script;
+  std::string json_out;
+  std::string baseline;
+  double tolerance = 0.10;
+  int server_pid = 0;
+  int drain_ms = 500;
+  // --generate
+  bool generate = false;
+  int clients = 50;
+  int teams = 8;
+  int lots = 10;
+  int bids_per_lot = 40;
+  int bid_gap_ms = 5;
+  unsigned seed = 1;
+};
+
+struct Step {
+  long at_ms;
+  int client;
+  std::string json;
+};
+
+enum Kind { kBid, kRename, kTeam, kKinds };
+const char *const kKindNames[kKinds] = {"bid", "rename", "team"};
+
+// Send times of in-flight messages, keyed by what their broadcast carries.
+class Inflight {
+public:
+  void sent(const std::string &key, Clock::time_point at) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sent_[key] = at;
+  }
+  bool find(const std::string &key, Clock::time_point &at) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = sent_.find(key);
+    if (it == sent_.end())
+      return false;
+    at = it->second;
+    return true;
+  }
+
+private:
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, Clock::time_point> sent_;
+};
+
+struct Client {
+  WsClient ws;
+  std::string username;
+  std::mutex mutex;
+  std::string next_bid = "0";
+  std::vector<long> latencies_us[kKinds];
+  std::uint64_t received = 0;
+  std::uint64_t bytes = 0;
+  std::thread reader;
+};
+
+std::vector<Step> generate(const Options &opt) {
+  std::mt19937 rng(opt.seed);
+  std::vector<Step> steps;
+  long t = 0;
+  for (int i = 1; i <= opt.clients; ++i)
+    steps.push_back({t++, i,
+                     "{\"type\":\"Change Team\",\"newTeam\":\"T" +
+                         std::to_string((i - 1) % opt.teams) + "\"}"});
+  for (int i = 1; i <= opt.clients; ++i)
+    steps.push_back({t++, i,
+                     "{\"type\":\"Change Username\",\"newUsername\":\"c" +
+                         std::to_string(i) + "\"}"});
+  t += 100;
+  steps.push_back({t, 0, "{\"type\":\"Start Auction\"}"});
+  t += 50;
+
+  std::uniform_int_distribution<int> pick(1, opt.clients);
+  for (int lot = 0; lot < opt.lots; ++lot) {
+    int last = 0;
+    for (int bid = 0; bid < opt.bids_per_lot; ++bid) {
+      int client;
+      do
+        client = pick(rng);
+      while (opt.clients > 1 && client == last);
+      last = client;
+      t += opt.bid_gap_ms;
+      steps.push_back({t, client,
+                       "{\"type\":\"Place Bid\",\"amount\":{{nextBid}},"
+                       "\"ref\":{{ref}}}"});
+    }
+    // A mid-auction team switch, like a user fixing a misclick.
+    int mover = pick(rng);
+    steps.push_back({t + 1, mover,
+                     "{\"type\":\"Change Team\",\"newTeam\":\"T" +
+                         std::to_string(lot % opt.teams) + "\"}"});
+    t += 20;
+    steps.push_back({t, 0, "{\"type\":\"Close Lot\"}"});
+    t += 50;
+  }
+  return steps;
+}
+
+bool load_script(const std::string &file, std::vector<Step> &steps) {
+  std::ifstream in(file);
+  if (!in)
+    return false;
+  for (std::string line; std::getline(in, line);) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    std::istringstream fields(line);
+    Step step;
+    if (!(fields >> step.at_ms >> step.client))
+      continue;
+    std::getline(fields >> std::ws, step.json);
+    steps.push_back(std::move(step));
+  }
+  return true;
+}
+
+void replace_all(std::string &text, const std::string &from,
+                 const std::string &to) {
+  for (auto pos = text.find(from); pos != std::string::npos;
+       pos = text.find(from, pos + to.size()))
+    text.replace(pos, from.size(), to);
+}
+
+// utime + stime of a process in seconds, or -1 if unavailable.
+double cpu_seconds(int pid) {
+  std::ifstream in("/proc/" + std::to_string(pid) + "/stat");
+  std::string stat;
+  if (!pid || !std::getline(in, stat))
+    return -1;
+  std::istringstream fields(stat.substr(stat.rfind(')') + 2));
+  std::string field;
+  unsigned long long utime = 0, stime = 0;
+  for (int i = 3; i <= 15 && fields >> field; ++i) {
+    if (i == 14)
+      utime = std::stoull(field);
+    else if (i == 15)
+      stime = std::stoull(field);
+  }
+  return static_cast<double>(utime + stime) / ::sysconf(_SC_CLK_TCK);
+}
+
+long percentile(const std::vector<long> &sorted, double p) {
+  if (sorted.empty())
+    return 0;
+  return sorted[std::min(sorted.size() - 1,
+                         static_cast<std::size_t>(p * sorted.size()))];
+}
+
+int main(int argc, char **argv) {
+  Options opt;
+  for (int i = 1; i < argc; ++i) {
+    std::string flag = argv[i];
+    if (flag == "--generate") {
+      opt.generate = true;
+      continue;
+    }
+    if (i + 1 >= argc)
+      break;
+    std::string value = argv[++i];
+    if (flag == "--host")
+      opt.server.host = value;
+    else if (flag == "--port")
+      opt.server.port = std::stoi(value);
+    else if (flag == "--script")
+      opt.script = value;
+    else if (flag == "--json")
+      opt.json_out = value;
+    else if (flag == "--baseline")
+      opt.baseline = value;
+    else if (flag == "--tolerance")
+      opt.tolerance = std::stod(value);
+    else if (flag == "--server-pid")
+      opt.server_pid = std::stoi(value);
+    else if (flag == "--drain-ms")
+      opt.drain_ms = std::stoi(value);
+    else if (flag == "--clients")
+      opt.clients = std::stoi(value);
+    else if (flag == "--teams")
+      opt.teams = std::stoi(value);
+    else if (flag == "--lots")
+      opt.lots = std::stoi(value);
+    else if (flag == "--bids-per-lot")
+      opt.bids_per_lot = std::stoi(value);
+    else if (flag == "--bid-gap-ms")
+      opt.bid_gap_ms = std::stoi(value);
+    else if (flag == "--seed")
+      opt.seed = static_cast<unsigned>(std::stoul(value));
+  }
+
+  if (opt.generate) {
+    std::cout << "# at_ms client json\n";
+    for (const auto &step : generate(opt))
+      std::cout << step.at_ms << " " << step.client << " " << step.json
+                << "\n";
+    return 0;
+  }
+
+  std::vector<Step> steps;
+  if (opt.script.empty() || !load_script(opt.script, steps)) {
+    std::cerr << "usage: replay --script FILE | --generate\n";
+    return 2;
+  }
+  int clients = 0;
+  for (const auto &step : steps)
+    clients = std::max(clients, step.client);
+
+  // Client 0 creates the room; everyone else joins it.
+  std::vector<Client> pool(clients + 1);
+  HttpResult leader = http_post(opt.server, "/create-room");
+  std::string roomId = json_field(leader.body, "room-id");
+  if (leader.status != 200 || roomId.empty() || leader.token.empty()) {
+    std::cerr << "create-room failed (" << leader.status << ")\n";
+    return 2;
+  }
+  std::vector<std::string> tokens{leader.token};
+  pool[0].username = json_field(leader.body, "username");
+  for (int i = 1; i <= clients; ++i) {
+    HttpResult joined = http_post(opt.server, "/join-room/" + roomId);
+    if (joined.status != 200 || joined.token.empty()) {
+      std::cerr << "join-room failed (" << joined.status << ")\n";
+      return 2;
+    }
+    tokens.push_back(joined.token);
+    pool[i].username = json_field(joined.body, "username");
+  }
+
+  Inflight inflight;
+  std::atomic<int> ready{0};
+  for (int i = 0; i <= clients; ++i) {
+    Client &c = pool[i];
+    if (!c.ws.open(opt.server, tokens[i])) {
+      std::cerr << "client " << i << " failed to connect\n";
+      return 2;
+    }
+    c.reader = std::thread([&c, &inflight, &ready] {
+      std::string msg;
+      bool counted = false;
+      while (c.ws.receive(msg)) {
+        auto now = Clock::now();
+        ++c.received;
+        c.bytes += msg.size();
+        std::string type = json_field(msg, "type");
+        if (!counted && type == "Your Team") {
+          counted = true;
+          ready.fetch_add(1);
+        }
+        std::string nextBid = json_field(msg, "nextBid");
+        if (!nextBid.empty()) {
+          std::lock_guard<std::mutex> lock(c.mutex);
+          c.next_bid = nextBid;
+        }
+
+        Kind kind;
+        std::string key;
+        if (type == "Bid Accepted") {
+          kind = kBid;
+          key = "ref:" + json_field(msg, "ref");
+        } else if (type == "Username Change") {
+          kind = kRename;
+          key = "name:" + json_field(msg, "newUsername");
+        } else if (type == "Team Change") {
+          kind = kTeam;
+          key = "team:" + json_field(msg, "username") + ":" +
+                json_field(msg, "team");
+        } else {
+          continue;
+        }
+        Clock::time_point sent;
+        if (inflight.find(key, sent))
+          c.latencies_us[kind].push_back(
+              std::chrono::duration_cast<std::chrono::microseconds>(now - sent)
+                  .count());
+      }
+    });
+  }
+  while (ready.load() <= clients)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  double cpu_before = cpu_seconds(opt.server_pid);
+  std::uint64_t sent = 0;
+  std::int64_t ref = 0;
+  auto start = Clock::now();
+  for (const auto &step : steps) {
+    std::this_thread::sleep_until(start +
+                                  std::chrono::milliseconds(step.at_ms));
+    Client &c = pool[step.client];
+    std::string json = step.json;
+    if (json.find("{{nextBid}}") != std::string::npos) {
+      std::lock_guard<std::mutex> lock(c.mutex);
+      replace_all(json, "{{nextBid}}", c.next_bid);
+    }
+    replace_all(json, "{{ref}}", std::to_string(++ref));
+
+    std::string type = json_field(json, "type");
+    std::string key;
+    if (type == "Place Bid") {
+      key = "ref:" + json_field(json, "ref");
+    } else if (type == "Change Username") {
+      c.username = json_field(json, "newUsername");
+      key = "name:" + c.username;
+    } else if (type == "Change Team") {
+      key = "team:" + c.username + ":" + json_field(json, "newTeam");
+    }
+    if (!key.empty())
+      inflight.sent(key, Clock::now());
+    if (c.ws.send(json))
+      ++sent;
+  }
+  auto last_send = Clock::now();
+  std::this_thread::sleep_for(std::chrono::milliseconds(opt.drain_ms));
+  double cpu_after = cpu_seconds(opt.server_pid);
+  for (auto &c : pool)
+    c.ws.shutdown();
+  for (auto &c : pool)
+    c.reader.join();
+
+  std::vector<long> all;
+  std::vector<long> by_kind[kKinds];
+  std::uint64_t received = 0;
+  std::uint64_t bytes = 0;
+  for (auto &c : pool) {
+    for (int k = 0; k < kKinds; ++k) {
+      by_kind[k].insert(by_kind[k].end(), c.latencies_us[k].begin(),
+                        c.latencies_us[k].end());
+      all.insert(all.end(), c.latencies_us[k].begin(),
+                 c.latencies_us[k].end());
+    }
+    received += c.received;
+    bytes += c.bytes;
+  }
+  std::sort(all.begin(), all.end());
+  for (auto &samples : by_kind)
+    std::sort(samples.begin(), samples.end());
+
+  std::chrono::duration<double> elapsed = last_send - start;
+  double seconds = std::max(elapsed.count(), 1e-3);
+  double cpu = cpu_before < 0 ? -1 : cpu_after - cpu_before;
+  double wall = seconds + opt.drain_ms / 1000.0;
+
+  std::ostringstream json;
+  json << "{\"clients\":" << clients + 1 << ",\"sent\":" << sent
+       << ",\"received\":" << received << ",\"received_bytes\":" << bytes
+       << ",\"delivered\":" << all.size() << ",\"duration_s\":" << seconds
+       << ",\"sent_per_s\":" << sent / seconds
+       << ",\"delivered_per_s\":" << all.size() / seconds
+       << ",\"p50_us\":" << percentile(all, 0.50)
+       << ",\"p99_us\":" << percentile(all, 0.99)
+       << ",\"p999_us\":" << percentile(all, 0.999)
+       << ",\"max_us\":" << (all.empty() ? 0 : all.back());
+  for (int k = 0; k < kKinds; ++k)
+    json << ",\"" << kKindNames[k] << "_p99_us\":"
+         << percentile(by_kind[k], 0.99);
+  json << ",\"server_cpu_s\":" << cpu
+       << ",\"server_cpu_pct\":" << (cpu < 0 ? -1 : 100 * cpu / wall) << "}";
+
+  std::cout << "clients=" << clients + 1 << " sent=" << sent
+            << " delivered=" << all.size() << " in " << seconds << "s ("
+            << static_cast<long>(all.size() / seconds) << " deliveries/s)\n";
+  std::cout << "fan-out us: p50=" << percentile(all, 0.50)
+            << " p99=" << percentile(all, 0.99)
+            << " p999=" << percentile(all, 0.999)
+            << " max=" << (all.empty() ? 0 : all.back()) << "\n";
+  for (int k = 0; k < kKinds; ++k)
+    std::cout << "  " << kKindNames[k] << ": n=" << by_kind[k].size()
+              << " p50=" << percentile(by_kind[k], 0.50)
+              << " p99=" << percentile(by_kind[k], 0.99) << "\n";
+  if (cpu >= 0)
+    std::cout << "server cpu: " << cpu << "s (" << 100 * cpu / wall
+              << "%)\n";
+  if (!opt.json_out.empty())
+    std::ofstream(opt.json_out) << json.str() << "\n";
+  if (all.empty()) {
+    std::cerr << "no broadcasts were delivered\n";
+    return 2;
+  }
+
+  if (!opt.baseline.empty()) {
+    std::ifstream in(opt.baseline);
+    std::string base((std::istreambuf_iterator<char>(in)),
+                     std::istreambuf_iterator<char>());
+    std::string base_p99 = json_field(base, "p99_us");
+    std::string base_rate = json_field(base, "delivered_per_s");
+    if (base_p99.empty() || base_rate.empty()) {
+      std::cerr << "unreadable baseline " << opt.baseline << "\n";
+      return 2;
+    }
+    bool slower = percentile(all, 0.99) >
+                  std::stod(base_p99) * (1 + opt.tolerance);
+    bool fewer = all.size() / seconds <
+                 std::stod(base_rate) * (1 - opt.tolerance);
+    if (slower || fewer) {
+      std::cout << "FAIL: regressed against " << opt.baseline << " (p99 "
+                << base_p99 << "us, " << base_rate << " deliveries/s)\n";
+      return 1;
+    }
+    std::cout << "PASS: within " << opt.tolerance * 100 << "% of "
+              << opt.baseline << "\n";
+  }
+  return 0;
+}
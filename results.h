@@ -0,0 +1,324 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "catalog.h"
+#include "money.h"
+
+// Append-only lot outcomes, one fixed-width column per field. Alongside the
+// outcome each row copies the player's set, role and country ids out of the
+// catalog, so a group-by reads two or three flat arrays and never gathers
+// through the player index.
+//
+// Rows live in segments that double in size (256, 512, ... up to 64K rows)
+// and never move. A query copies the list of segments and how many rows
+// each holds under the mutex, then scans them without it, so a long query
+// never holds up the rooms appending to the store. A store given a row
+// limit grows no segment past it and drops its oldest segment whenever the
+// rows after it reach the limit, so it keeps the newest max_rows lots and
+// at most one segment more.
+class ResultsStore {
+public:
+  // Team id of an unsold lot.
+  static constexpr std::uint16_t kUnsold = 0xffff;
+
+  enum class GroupBy { Team, Set, Role, Country };
+
+  struct Row {
+    std::uint32_t player; // catalog index
+    std::string team;     // empty if unsold
+    Money price;
+    std::uint32_t bids;
+  };
+
+  // Sums over one group's lots. For teams, a group's lots are the ones it
+  // bought.
+  struct Totals {
+    std::string group;
+    std::uint64_t lots = 0;
+    std::uint64_t sold = 0;
+    // Base prices and final prices of the lots sold.
+    std::int64_t base_lakhs = 0;
+    std::int64_t price_lakhs = 0;
+
+    double unsold_rate() const {
+      return lots ? static_cast<double>(lots - sold) / lots : 0;
+    }
+    // Average paid over base price, as a fraction of base price.
+    double premium() const {
+      return base_lakhs ? static_cast<double>(price_lakhs - base_lakhs) /
+                              static_cast<double>(base_lakhs)
+                        : 0;
+    }
+  };
+
+  // 0 keeps every row.
+  explicit ResultsStore(std::size_t max_rows = 0) : max_rows_(max_rows) {}
+  ResultsStore(const ResultsStore &) = delete;
+  ResultsStore &operator=(const ResultsStore &) = delete;
+
+  void append(const Catalog &catalog, const Row &row) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    append_locked(catalog, row);
+  }
+
+  // Appends several rows under one hold of the writer lock.
+  void append(const Catalog &catalog, const std::vector<Row> &rows) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const Row &row : rows)
+      append_locked(catalog, row);
+  }
+
+  // Rows currently held.
+  std::size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+  // One entry per group with at least one lot; names for set, role and
+  // country come from `catalog`, which must be the one appended with.
+  std::vector<Totals> totals(GroupBy by, const Catalog &catalog) const {
+    std::vector<std::pair<std::shared_ptr<const Segment>, std::size_t>>
+        segments;
+    std::size_t groups = 0;
+    bool dense;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (const auto &segment : segments_)
+        segments.emplace_back(segment, segment->used);
+      switch (by) {
+      case GroupBy::Team:
+        groups = teams_.size();
+        break;
+      case GroupBy::Set:
+        groups = catalog.sets().size();
+        break;
+      case GroupBy::Role:
+        groups = catalog.roles().size();
+        break;
+      case GroupBy::Country:
+        groups = catalog.countries().size();
+        break;
+      }
+      dense = groups <= kDenseGroups && max_price_ <= kDenseMaxPrice;
+    }
+
+    // One spare slot catches unsold rows when grouping by team.
+    std::vector<Totals> sums(groups + 1);
+    for (const auto &[seg, n] : segments) {
+      const std::uint16_t *keys = seg->team.get();
+      if (by == GroupBy::Set)
+        keys = seg->set.get();
+      else if (by == GroupBy::Role)
+        keys = seg->role.get();
+      else if (by == GroupBy::Country)
+        keys = seg->country.get();
+      if (dense)
+        accumulate_dense(*seg, n, keys, sums);
+      else
+        accumulate_sparse(*seg, n, keys, sums);
+    }
+
+    std::vector<Totals> out;
+    std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+    if (by == GroupBy::Team)
+      lock.lock();
+    for (std::size_t g = 0; g < groups; ++g) {
+      if (!sums[g].lots)
+        continue;
+      auto id = static_cast<std::uint16_t>(g);
+      switch (by) {
+      case GroupBy::Team:
+        sums[g].group = teams_[id];
+        break;
+      case GroupBy::Set:
+        sums[g].group = catalog.sets()[id];
+        break;
+      case GroupBy::Role:
+        sums[g].group = catalog.roles()[id];
+        break;
+      case GroupBy::Country:
+        sums[g].group = catalog.countries()[id];
+        break;
+      }
+      out.push_back(std::move(sums[g]));
+    }
+    return out;
+  }
+
+private:
+  static constexpr std::size_t kFirstSegment = 256;
+  static constexpr std::size_t kMaxSegment = 1 << 16;
+  // Up to this many groups a query makes one branch-free pass per group over
+  // each block of kBlock rows, which vectorizes; past it, or once a price
+  // too large for the block sums was stored, one scattering pass.
+  static constexpr std::size_t kDenseGroups = 8;
+  static constexpr std::size_t kBlock = 256;
+  static constexpr std::int32_t kDenseMaxPrice =
+      std::numeric_limits<std::int32_t>::max() / kBlock;
+
+  struct Segment {
+    explicit Segment(std::size_t rows)
+        : capacity(rows), player(new std::uint32_t[rows]),
+          team(new std::uint16_t[rows]), set(new std::uint16_t[rows]),
+          role(new std::uint16_t[rows]), country(new std::uint16_t[rows]),
+          price(new std::int32_t[rows]), base(new std::int32_t[rows]),
+          bids(new std::uint32_t[rows]) {}
+
+    std::size_t capacity;
+    // Rows written; guarded by the store's mutex.
+    std::size_t used = 0;
+    std::unique_ptr<std::uint32_t[]> player;
+    std::unique_ptr<std::uint16_t[]> team;
+    std::unique_ptr<std::uint16_t[]> set;
+    std::unique_ptr<std::uint16_t[]> role;
+    std::unique_ptr<std::uint16_t[]> country;
+    std::unique_ptr<std::int32_t[]> price; // lakhs
+    std::unique_ptr<std::int32_t[]> base;  // lakhs
+    std::unique_ptr<std::uint32_t[]> bids;
+  };
+
+  void append_locked(const Catalog &catalog, const Row &row) {
+    if (segments_.empty() ||
+        segments_.back()->used == segments_.back()->capacity) {
+      std::size_t rows =
+          segments_.empty()
+              ? kFirstSegment
+              : std::min(segments_.back()->capacity * 2, kMaxSegment);
+      if (max_rows_)
+        rows = std::min(rows, max_rows_);
+      segments_.push_back(std::make_shared<Segment>(rows));
+    }
+    Segment &seg = *segments_.back();
+    std::size_t at = seg.used;
+    seg.player[at] = row.player;
+    seg.team[at] = row.team.empty() || teams_.size() >= kUnsold
+                       ? kUnsold
+                       : teams_.intern(row.team);
+    seg.set[at] = catalog.set_id(row.player);
+    seg.role[at] = catalog.role_id(row.player);
+    seg.country[at] = catalog.country_id(row.player);
+    seg.price[at] = row.team.empty() ? 0 : row.price.lakhs();
+    seg.base[at] = catalog.base_price(row.player).lakhs();
+    seg.bids[at] = row.bids;
+    max_price_ = std::max({max_price_, seg.price[at], seg.base[at]});
+    ++seg.used;
+    ++rows_;
+    // Queries still scanning a dropped segment keep it alive until done.
+    while (max_rows_ && rows_ - segments_.front()->used >= max_rows_) {
+      rows_ -= segments_.front()->used;
+      segments_.pop_front();
+    }
+    size_.store(rows_, std::memory_order_relaxed);
+  }
+
+  struct Sums {
+    std::int64_t lots = 0, sold = 0, base = 0, price = 0;
+  };
+
+  // Sums of the rows in `group` among at most kBlock rows. Branch-free and
+  // in 32-bit lanes, so with rows == kBlock the compiler unrolls and
+  // vectorizes it even at -O2; prices up to kDenseMaxPrice cannot overflow.
+  static Sums group_sums(const std::uint16_t *keys, const std::uint16_t *team,
+                         const std::int32_t *base, const std::int32_t *price,
+                         std::size_t rows, std::uint16_t group) {
+    std::int32_t lots = 0, sold = 0, base_sum = 0, price_sum = 0;
+    for (std::size_t i = 0; i < rows; ++i) {
+      // All ones if the row is in the group (and sold), else zero.
+      std::int32_t in = -static_cast<std::int32_t>(keys[i] == group);
+      std::int32_t hit = in & -static_cast<std::int32_t>(team[i] != kUnsold);
+      lots -= in;
+      sold -= hit;
+      base_sum += base[i] & hit;
+      price_sum += price[i] & hit;
+    }
+    return Sums{lots, sold, base_sum, price_sum};
+  }
+
+  // Every group's sums over a block of rows that stays in L1 cache, one
+  // vectorized pass per group.
+  static void accumulate_dense(const Segment &seg, std::size_t n,
+                               const std::uint16_t *keys,
+                               std::vector<Totals> &out) {
+    const std::size_t groups = out.size() - 1;
+    for (std::size_t first = 0; first < n; first += kBlock) {
+      const std::uint16_t *team = seg.team.get() + first;
+      const std::int32_t *base = seg.base.get() + first;
+      const std::int32_t *price = seg.price.get() + first;
+      for (std::size_t g = 0; g < groups; ++g) {
+        auto group = static_cast<std::uint16_t>(g);
+        Sums sums = n - first >= kBlock
+                        ? group_sums(keys + first, team, base, price, kBlock,
+                                     group)
+                        : group_sums(keys + first, team, base, price,
+                                     n - first, group);
+        out[g].lots += static_cast<std::uint64_t>(sums.lots);
+        out[g].sold += static_cast<std::uint64_t>(sums.sold);
+        out[g].base_lakhs += sums.base;
+        out[g].price_lakhs += sums.price;
+      }
+    }
+  }
+
+  static void accumulate_sparse(const Segment &seg, std::size_t n,
+                                const std::uint16_t *keys,
+                                std::vector<Totals> &sums) {
+    const std::size_t spare = sums.size() - 1;
+    const std::uint16_t *team = seg.team.get();
+    const std::int32_t *price = seg.price.get();
+    const std::int32_t *base = seg.base.get();
+    for (std::size_t i = 0; i < n; ++i) {
+      Totals &sum = sums[std::min<std::size_t>(keys[i], spare)];
+      std::int64_t hit = team[i] != kUnsold;
+      sum.lots += 1;
+      sum.sold += static_cast<std::uint64_t>(hit);
+      sum.base_lakhs += hit * base[i];
+      sum.price_lakhs += hit * price[i];
+    }
+  }
+
+  const std::size_t max_rows_;
+  // Guards everything below but size_, and the rows of each segment up to
+  // its `used` count.
+  mutable std::mutex mutex_;
+  std::deque<std::shared_ptr<Segment>> segments_;
+  std::size_t rows_ = 0;
+  // Largest price or base price ever stored.
+  std::int32_t max_price_ = 0;
+  StringPool teams_;
+  // rows_, for size() without the lock.
+  std::atomic<std::size_t> size_{0};
+};
+
+inline const char *group_by_name(ResultsStore::GroupBy by) {
+  switch (by) {
+  case ResultsStore::GroupBy::Team:
+    return "team";
+  case ResultsStore::GroupBy::Set:
+    return "set";
+  case ResultsStore::GroupBy::Role:
+    return "role";
+  case ResultsStore::GroupBy::Country:
+    return "country";
+  }
+  return "";
+}
+
+// Returns false for an unknown name.
+inline bool group_by_for(std::string_view name, ResultsStore::GroupBy &by) {
+  for (auto candidate :
+       {ResultsStore::GroupBy::Team, ResultsStore::GroupBy::Set,
+        ResultsStore::GroupBy::Role, ResultsStore::GroupBy::Country}) {
+    if (name == group_by_name(candidate)) {
+      by = candidate;
+      return true;
+    }
+  }
+  return false;
+}
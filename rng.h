@@ -0,0 +1,69 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <thread>
+
+// xoshiro256**: a small, fast generator for ids and names. Not for secrets.
+// Satisfies UniformRandomBitGenerator, so the <random> distributions accept
+// it, though below() is cheaper for picking an index.
+class FastRng {
+public:
+  using result_type = std::uint64_t;
+
+  explicit FastRng(std::uint64_t seed) {
+    // Spread the seed over the whole state with splitmix64.
+    for (auto &word : state_) {
+      seed += 0x9e3779b97f4a7c15ull;
+      std::uint64_t z = seed;
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+      word = z ^ (z >> 31);
+    }
+  }
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return ~result_type(0); }
+
+  result_type operator()() {
+    std::uint64_t result = rotl(state_[1] * 5, 7) * 9;
+    std::uint64_t t = state_[1] << 17;
+    state_[2] ^= state_[0];
+    state_[3] ^= state_[1];
+    state_[1] ^= state_[2];
+    state_[0] ^= state_[3];
+    state_[2] ^= t;
+    state_[3] = rotl(state_[3], 45);
+    return result;
+  }
+
+  // Uniform in [0, bound) by multiply-shift; the bias is negligible for the
+  // small bounds used here.
+  std::uint64_t below(std::uint64_t bound) {
+    return static_cast<std::uint64_t>(
+        (static_cast<unsigned __int128>((*this)()) * bound) >> 64);
+  }
+
+private:
+  static std::uint64_t rotl(std::uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+  }
+
+  std::uint64_t state_[4];
+};
+
+// This thread's generator, seeded once from the OS entropy source mixed with
+// the clock and thread id, so threads and processes started together still
+// draw different sequences.
+inline FastRng &thread_rng() {
+  thread_local FastRng rng([] {
+    std::random_device device;
+    std::uint64_t seed = static_cast<std::uint64_t>(device()) << 32 | device();
+    seed ^= static_cast<std::uint64_t>(
+        std::chrono::steady_clock::now().time_since_epoch().count());
+    seed ^= std::hash<std::thread::id>{}(std::this_thread::get_id());
+    return seed;
+  }());
+  return rng;
+}
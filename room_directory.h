@@ -0,0 +1,86 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Room lookup by id, split across independently locked shards so that
+// creating or finding one room never waits on traffic for another. Rooms are
+// handed out as shared_ptr; callers lock the room itself for its state.
+template <typename Room, std::size_t Shards = 64> class RoomDirectory {
+public:
+  std::shared_ptr<Room> find(const std::string &roomId) const {
+    const Shard &shard = shard_for(roomId);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.rooms.find(roomId);
+    return it == shard.rooms.end() ? nullptr : it->second;
+  }
+
+  bool contains(const std::string &roomId) const {
+    const Shard &shard = shard_for(roomId);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    return shard.rooms.count(roomId) != 0;
+  }
+
+  // Returns the new room, or nullptr if the id is already taken.
+  std::shared_ptr<Room> create(const std::string &roomId) {
+    Shard &shard = shard_for(roomId);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto [it, inserted] = shard.rooms.try_emplace(roomId);
+    if (!inserted)
+      return nullptr;
+    it->second = std::make_shared<Room>();
+    return it->second;
+  }
+
+  bool erase(const std::string &roomId) {
+    Shard &shard = shard_for(roomId);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    return shard.rooms.erase(roomId) != 0;
+  }
+
+  std::size_t size() const {
+    std::size_t total = 0;
+    for (const Shard &shard : shards_) {
+      std::shared_lock<std::shared_mutex> lock(shard.mutex);
+      total += shard.rooms.size();
+    }
+    return total;
+  }
+
+  // Visits every room. Each shard is copied out before the callback runs so
+  // that f may lock rooms without holding a shard lock.
+  void for_each(const std::function<void(const std::string &,
+                                         const std::shared_ptr<Room> &)> &f)
+      const {
+    std::vector<std::pair<std::string, std::shared_ptr<Room>>> batch;
+    for (const Shard &shard : shards_) {
+      {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        batch.assign(shard.rooms.begin(), shard.rooms.end());
+      }
+      for (const auto &[roomId, room] : batch)
+        f(roomId, room);
+    }
+  }
+
+private:
+  struct alignas(64) Shard {
+    mutable std::shared_mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<Room>> rooms;
+  };
+
+  Shard &shard_for(const std::string &roomId) {
+    return shards_[std::hash<std::string>{}(roomId) % Shards];
+  }
+  const Shard &shard_for(const std::string &roomId) const {
+    return shards_[std::hash<std::string>{}(roomId) % Shards];
+  }
+
+  std::array<Shard, Shards> shards_;
+};
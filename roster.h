@@ -0,0 +1,145 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "player_table.h"
+#include "protocol.h"
+
+// A room's player list as a version number, a cached Player List snapshot
+// and a log of the deltas applied since. Every change bumps the version and
+// is recorded as the same frames that get broadcast, so catching a client up
+// sends pre-serialized bytes instead of walking the player table.
+//
+// Each player's list entry is encoded once when it changes and kept by table
+// slot; the snapshot is reassembled from those entries only after
+// kSnapshotLag deltas have piled up behind it. Not thread-safe: the owning
+// room's lock serializes calls.
+class Roster {
+public:
+  static constexpr std::size_t kLogCapacity = 256;
+  static constexpr std::size_t kSnapshotLag = 32;
+
+  struct Delta {
+    std::uint64_t version;
+    Frames frames;
+  };
+
+  std::uint64_t version() const { return version_; }
+
+  // Lists the player in `slot`, or refreshes a returning one. Returns the
+  // delta to broadcast, or nullptr if the player's entry is unchanged.
+  const Delta *join(std::uint32_t slot, const Player &player) {
+    if (slot >= entries_.size())
+      entries_.resize(slot + 1);
+    ListItem entry = encode_entry(player);
+    if (entry.json == entries_[slot].json)
+      return nullptr;
+    entries_[slot] = std::move(entry);
+    return record(Message(Opcode::NewPlayer)
+                      .set(Field::Username, player.username)
+                      .set(Field::Team, player.team)
+                      .set(Field::Role, role_name(player.role)));
+  }
+
+  // `player` is the slot's state after the rename.
+  const Delta *rename(std::uint32_t slot, std::string_view oldUsername,
+                      const Player &player) {
+    if (oldUsername == player.username)
+      return nullptr;
+    entries_[slot] = encode_entry(player);
+    return record(Message(Opcode::UsernameChange)
+                      .set(Field::OldUsername, oldUsername)
+                      .set(Field::NewUsername, player.username));
+  }
+
+  // `player` is the slot's state after the team change.
+  const Delta *change_team(std::uint32_t slot, const Player &player) {
+    ListItem entry = encode_entry(player);
+    if (entry.json == entries_[slot].json)
+      return nullptr;
+    entries_[slot] = std::move(entry);
+    return record(Message(Opcode::TeamChange)
+                      .set(Field::Username, player.username)
+                      .set(Field::Team, player.team));
+  }
+
+  // Unlists the player who held `slot`.
+  const Delta *leave(std::uint32_t slot, std::string_view username) {
+    if (slot >= entries_.size() || entries_[slot].json.empty())
+      return nullptr;
+    entries_[slot] = ListItem{};
+    return record(
+        Message(Opcode::PlayerLeft).set(Field::Username, username));
+  }
+
+  // Sets the version of a roster rebuilt with join() during recovery. The
+  // rebuild's own deltas are dropped, so every client resumes from the
+  // snapshot.
+  void restore(std::uint64_t version) {
+    version_ = version;
+    log_.clear();
+    snapshot_ = Frames{};
+    snapshot_version_ = version;
+  }
+
+  // Calls send(frames) with everything a client that has seen version
+  // `since` needs to be current: the deltas after `since` when the log still
+  // reaches back that far, otherwise the snapshot and the deltas after it.
+  template <typename Send> void catch_up(std::uint64_t since, Send &&send) {
+    if (since > version_ || since + 1 < first_logged())
+      since = 0;
+    if (since == 0) {
+      if (!snapshot_.json || version_ - snapshot_version_ > kSnapshotLag)
+        rebuild_snapshot();
+      send(snapshot_);
+      since = snapshot_version_;
+    }
+    for (const auto &delta : log_) {
+      if (delta.version > since)
+        send(delta.frames);
+    }
+  }
+
+private:
+  std::uint64_t first_logged() const {
+    return log_.empty() ? version_ + 1 : log_.front().version;
+  }
+
+  static ListItem encode_entry(const Player &player) {
+    return Message(Opcode::Unknown)
+        .set(Field::Username, player.username)
+        .set(Field::Team, player.team)
+        .set(Field::Role, role_name(player.role))
+        .item();
+  }
+
+  const Delta *record(Message &msg) {
+    msg.set(Field::Version, static_cast<std::int64_t>(++version_));
+    log_.push_back(Delta{version_, encode(msg)});
+    if (log_.size() > kLogCapacity)
+      log_.pop_front();
+    // The snapshot must stay within reach of the log.
+    if (version_ - snapshot_version_ >= kLogCapacity)
+      rebuild_snapshot();
+    return &log_.back();
+  }
+
+  void rebuild_snapshot() {
+    Message list(Opcode::PlayerList);
+    list.set(Field::Version, static_cast<std::int64_t>(version_));
+    for (const auto &entry : entries_) {
+      if (!entry.json.empty())
+        list.add(entry);
+    }
+    snapshot_ = encode(list);
+    snapshot_version_ = version_;
+  }
+
+  std::vector<ListItem> entries_;
+  std::uint64_t version_ = 0;
+  std::deque<Delta> log_;
+  Frames snapshot_;
+  std::uint64_t snapshot_version_ = 0;
+};
@@ -5,55 +5,795 @@
 #include <crow/common.h>
 #include <crow/http_response.h>
 #include <crow/logging.h>
-#include <jwt-cpp/jwt.h>
-#include <unordered_set>
+#include <array>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <cstdlib>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <sys/prctl.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "async_log.h"
+#include "auction.h"
+#include "auth.h"
+#include "cluster.h"
+#include "command_queue.h"
+#include "event_log.h"
+#include "lot_plan.h"
+#include "lot_queue.h"
+#include "metrics.h"
+#include "outbox.h"
+#include "player_table.h"
+#include "protocol.h"
+#include "results.h"
+#include "room_directory.h"
+#include "rng.h"
+#include "roster.h"
+#include "spectators.h"
+#include "timer_wheel.h"
 
 std::string domain = "bidblitz.com";
 std::string jwtSecret = "kohligoat";
+const auto bidTimeout = std::chrono::seconds(20);
+// Distinct team names a room will intern, "observer" included.
+const std::size_t kMaxTeams = 256;
+// How long a disconnected player keeps their slot and team.
+const auto reconnectGrace = std::chrono::minutes(2);
+// A room nobody is connected to is freed after this long, or on the next
+// sweep once its auction is over.
+const auto idleRoomTimeout = std::chrono::minutes(30);
+// Spectators alone keep a room at most this long after its last player
+// left; a finished room is freed with them still watching.
+const auto spectatedRoomTimeout = std::chrono::hours(2);
+const auto reapInterval = std::chrono::seconds(30);
+// Most queued commands a room applies under one hold of its lock.
+const std::size_t kCommandBatch = 256;
+// Batches an io thread drains from a room's queue before handing the rest
+// to commandExecutor, so a busy room cannot hold it indefinitely.
+const std::size_t kDrainBatches = 4;
+// Spectators a room will take on top of its players.
+const std::size_t kMaxSpectators = 10000;
+
+// This process's share of the rooms in multi-process mode; see cluster.h.
+unsigned workerIndex = 0;
+unsigned workerCount = 1;
+// The router's public port; worker i listens on routerPort + 1 + i.
+int routerPort = 0;
+// How long a worker waits on a peer before treating it as down.
+const auto peerTimeout = std::chrono::milliseconds(500);
+
+Endpoint peer_worker(unsigned index) {
+  return Endpoint{"127.0.0.1", routerPort + 1 + static_cast<int>(index)};
+}
+
+// Server-wide scheduler, advanced from the app's tick on the main io loop.
+TimerWheel lotTimers;
+// Every state change is journaled here; rooms are rebuilt from it on start.
+EventLog eventLog("journal");
+
+// The newest lots closed across this worker's rooms, queried by the /results
+// routes; each room also keeps all of its own. Kept to kMaxResultRows rows
+// (about 24 bytes each) so a long-running server's memory stays flat: older
+// lots roll off a segment at a time. On start it is rebuilt from the rooms
+// recovered from the journal, so lots of rooms reaped before the last
+// restart are not in it. /results merges every worker's; see its route.
+constexpr std::size_t kMaxResultRows = std::size_t(1) << 21;
+ResultsStore allResults(kMaxResultRows);
 
+// Upstream of every room's arena; counts the heap traffic rooms cause.
+CountingResource roomHeap;
+
+// Hot-path instrumentation, exported on /metrics.
+Metrics metrics;
+const Metrics::Id lockWaitTime =
+    metrics.histogram("room_lock_wait_seconds",
+                      "Time spent waiting to acquire a room lock",
+                      Metrics::Unit::Seconds);
+const Metrics::Id lockHoldTime =
+    metrics.histogram("room_lock_hold_seconds", "Time a room lock was held",
+                      Metrics::Unit::Seconds);
+const Metrics::Id commandBatch =
+    metrics.histogram("room_command_batch", "Client commands per room batch",
+                      Metrics::Unit::Count);
+const Metrics::Id fanOut =
+    metrics.histogram("broadcast_recipients", "Connections per broadcast",
+                      Metrics::Unit::Count);
+const Metrics::Id broadcastTime =
+    metrics.histogram("broadcast_seconds",
+                      "Time to queue one broadcast for every recipient",
+                      Metrics::Unit::Seconds);
+const Metrics::Id jwtVerifyTime =
+    metrics.histogram("jwt_verify_seconds", "Time to verify a token",
+                      Metrics::Unit::Seconds);
+const Metrics::Id broadcastBytes = metrics.counter(
+    "broadcast_bytes_total", "Bytes queued by broadcasts, all recipients");
+const Metrics::Id connectionsOpened = metrics.counter(
+    "ws_connections_opened_total", "WebSocket connections accepted");
+const Metrics::Id connectionsClosed = metrics.counter(
+    "ws_connections_closed_total", "WebSocket connections closed");
+const Metrics::Id connectionErrors = metrics.counter(
+    "ws_connection_errors_total", "WebSocket connections that failed");
+const Metrics::Id playersExpired = metrics.counter(
+    "players_expired_total", "Players dropped after the reconnect grace");
+const Metrics::Id roomsReaped =
+    metrics.counter("rooms_reaped_total", "Rooms freed by the reaper");
+const Metrics::Id spectatorsJoined =
+    metrics.counter("spectators_joined_total", "Spectator connections opened");
+const Metrics::Id spectatorsLeft =
+    metrics.counter("spectators_left_total", "Spectator connections closed");
+
+// Handler latency histogram for a client opcode, one series per type.
+Metrics::Id handler_time(Opcode op) {
+  static const auto ids = [] {
+    std::array<Metrics::Id, 6> ids{};
+    for (std::size_t i = 0; i < ids.size(); ++i) {
+      const char *name = protocol::opcode_name(static_cast<Opcode>(i));
+      ids[i] = metrics.histogram(
+          "ws_handler_seconds", "Time to handle one client message",
+          Metrics::Unit::Seconds,
+          std::string("type=\"") + (*name ? name : "Unknown") + "\"");
+    }
+    return ids;
+  }();
+  auto index = static_cast<std::size_t>(op);
+  return ids[index < ids.size() ? index : 0];
+}
+
+// The first character is drawn so that cluster::owner maps the id back to
+// this worker. Callers claim the id with RoomDirectory::create, which fails
+// on a collision, and draw again.
 std::string generateRoomId() {
-  static const std::string chars =
-      "abcdefghijklmnopqrstuvwxyzABCDEFGHJKLMNPQRSTUVWXYZ23456789";
-  static std::mt19937 rng(std::time(nullptr));
-  std::uniform_int_distribution<std::size_t> distribution(0, chars.size() - 1);
+  const std::string_view chars = cluster::kRoomIdChars;
+  FastRng &rng = thread_rng();
 
   std::string roomId;
   roomId.reserve(8);
 
-  for (int i = 0; i < 8; ++i) {
-    roomId += chars[distribution(rng)];
+  // Leading characters this worker owns: workerIndex, +workerCount, ...
+  std::size_t leads = (chars.size() - 1 - workerIndex) / workerCount + 1;
+  roomId += chars[workerIndex + workerCount * rng.below(leads)];
+  for (int i = 1; i < 8; ++i) {
+    roomId += chars[rng.below(chars.size())];
   }
 
   return roomId;
 }
 
-class Auction {
-public:
-  enum class Status { TeamSelection, InProgress, Paused, Cancelled };
-  Status status;
-  Auction() : status(Status::TeamSelection) {}
+class Room;
 
-private:
-};
+using Players = PlayerTable<crow::websocket::connection>;
+using ConnOutbox = Outbox<crow::websocket::connection>;
+using Spectators = SpectatorTier<crow::websocket::connection>;
 
-struct Player {
-  std::string username;
-  std::string team;
-  std::string role;
-};
+// Sends every room's spectators their updates, once a SPECTATOR_TICK_MS.
+SpectatorHub<crow::websocket::connection> spectatorHub;
+// Continues draining rooms whose command queue outlasted kDrainBatches.
+Executor commandExecutor;
+// Re-flushes outboxes whose Crow write window was full; see outbox.h.
+OutboxPacer<crow::websocket::connection> outboxPacer;
 
 struct ConnData {
-  std::string roomId;
-  Player player;
+  std::shared_ptr<Room> room;
+  // This connection's player in room->players; read it under room->mutex.
+  // kNoSlot for a spectator.
+  Players::Slot slot;
+  // Negotiated with /wsrooms?format=binary; JSON text frames otherwise.
+  bool binary = false;
+  // Last roster version the client saw (/wsrooms?since=N), 0 for none.
+  std::uint64_t since = 0;
+  // Created in onopen; every frame to this connection goes through it.
+  std::shared_ptr<ConnOutbox> outbox;
+
+  bool spectator() const { return slot == Players::kNoSlot; }
 };
 
-class Room {
+// Coalescing key for a per-player state update: a newer update of the same
+// kind for the same slot replaces one still queued.
+std::uint64_t coalesce_key(Opcode op, Players::Slot slot) {
+  return static_cast<std::uint64_t>(op) << 32 | slot;
+}
+
+// A parsed client command waiting in its room's queue.
+struct RoomCommand {
+  Command cmd;
+  // The sender, compared against but never dereferenced: it may have
+  // closed by the time the command is applied.
+  crow::websocket::connection *conn;
+  Players::Slot slot;
+  std::shared_ptr<ConnOutbox> outbox;
+};
+
+class Room : public std::enable_shared_from_this<Room> {
 public:
-  std::unordered_map<crow::websocket::connection *, Player> players;
-  std::unordered_set<crow::websocket::connection *> connections;
-  Auction auction;
+  // Holds the room's mutex. On release it unlocks first and then flushes the
+  // outboxes that frames were queued on and refills the lot queue, so no
+  // socket write or prefetch happens under the room lock.
+  class Lock {
+  public:
+    explicit Lock(Room &room) : room_(room) {
+      auto start = Metrics::Clock::now();
+      room_.mutex.lock();
+      acquired_ = Metrics::Clock::now();
+      metrics.observe(lockWaitTime, acquired_ - start);
+    }
+    ~Lock() {
+      std::vector<std::shared_ptr<ConnOutbox>> ready;
+      ready.swap(room_.ready_);
+      room_.mutex.unlock();
+      metrics.observe(lockHoldTime, Metrics::Clock::now() - acquired_);
+      for (auto &outbox : ready)
+        outbox->flush();
+      // Lot announcements opening a lot left to encode ahead.
+      room_.lots.refill();
+    }
+    Lock(const Lock &) = delete;
+    Lock &operator=(const Lock &) = delete;
+
+  private:
+    Room &room_;
+    Metrics::Clock::time_point acquired_;
+  };
+
+  std::mutex mutex;
+  std::string id;
+  // Commands from the room's connections, applied in arrival order.
+  CommandQueue<RoomCommand> commands;
+  // Number of events journaled for this room; replay skips any event at or
+  // below it because a snapshot already covers it.
+  std::uint64_t journal_seq = 0;
+  // Backs the player table and is released with the room in one go.
+  RoomArena arena{&roomHeap};
+  Players players{&arena};
+  Roster roster;
+  Auction auction{SquadRules{}, &arena};
+  LotQueue lots;
+  // Outcome of every lot closed live in this room. Thread-safe on its own:
+  // queries read it without the room lock.
+  ResultsStore results;
+  // The last lot event and the bid after it, as published.
+  Frames lot_frames;
+  Frames bid_frames;
+  // Watchers outside the player table; fed from spectatorHub's thread.
+  std::shared_ptr<Spectators> spectators = std::make_shared<Spectators>();
+  // Bids only push lot_deadline forward; the timer re-arms itself when it
+  // fires early, so a bid never touches the wheel.
+  std::chrono::steady_clock::time_point lot_deadline;
+  TimerWheel::TimerId lot_timer = TimerWheel::kNoTimer;
+  // Offline players and when their reconnect grace runs out.
+  std::unordered_map<Players::Slot, std::chrono::steady_clock::time_point>
+      leaving;
+  // Since when no player has been connected; the reaper frees idle rooms.
+  std::chrono::steady_clock::time_point idle_since =
+      std::chrono::steady_clock::now();
+  // Set by the reaper before the room leaves the directory, so a join that
+  // found it just before is turned away.
+  bool closed = false;
+
+  // Queues msg for one connection, encoded only in its format. Caller must
+  // hold a Lock.
+  void send(crow::websocket::connection &conn, const Message &msg) {
+    auto *cd = static_cast<ConnData *>(conn.userdata());
+    if (cd)
+      send(cd->outbox, msg);
+  }
+
+  void send(const std::shared_ptr<ConnOutbox> &outbox, const Message &msg) {
+    if (!outbox)
+      return;
+    Frames frames;
+    if (outbox->binary())
+      frames.binary = std::make_shared<const std::string>(msg.binary());
+    else
+      frames.json = std::make_shared<const std::string>(msg.json());
+    queue(outbox, frames);
+  }
+
+  void send(crow::websocket::connection &conn, const Frames &frames) {
+    auto *cd = static_cast<ConnData *>(conn.userdata());
+    if (cd && cd->outbox)
+      queue(cd->outbox, frames);
+  }
+
+  // Serializes msg once per wire format and queues it for every connection
+  // but `except`. Its fan-out, bytes and time go to metrics. Caller must
+  // hold a Lock.
+  void broadcast(const Message &msg,
+                 crow::websocket::connection *except = nullptr) {
+    broadcast(encode(msg), except);
+  }
+
+  void broadcast(const Frames &frames,
+                 crow::websocket::connection *except = nullptr,
+                 std::uint64_t coalesce_key = 0) {
+    auto start = Metrics::Clock::now();
+    std::size_t recipients = 0;
+    std::size_t bytes = 0;
+    for (const auto &[conn, _] : players.connections()) {
+      auto *cd = static_cast<ConnData *>(conn->userdata());
+      if (conn == except || !cd || !cd->outbox)
+        continue;
+      queue(cd->outbox, frames, coalesce_key);
+      bytes += frames.get(cd->binary).size();
+      ++recipients;
+    }
+    metrics.observe(broadcastTime, Metrics::Clock::now() - start);
+    metrics.observe(fanOut, recipients);
+    metrics.add(broadcastBytes, bytes);
+  }
+
+  // Hands a lot event or the latest bid to the spectator tier, and keeps it
+  // for players who join mid-lot. Caller must hold a Lock.
+  void publish_lot(const Frames &frames) {
+    lot_frames = frames;
+    bid_frames = Frames{};
+    if (spectators->publish_lot(frames))
+      spectatorHub.schedule(spectators);
+  }
+  void publish_bid(const Frames &frames) {
+    bid_frames = frames;
+    if (spectators->publish_bid(frames))
+      spectatorHub.schedule(spectators);
+  }
+
+  // Sends a player joining or returning mid-auction the open lot and its
+  // latest bid, as spectators get on arrival. Caller must hold a Lock.
+  void send_lot_state(crow::websocket::connection &conn) {
+    if (auction.status != Auction::Status::InProgress || !auction.has_lot())
+      return;
+    // A recovered room has published nothing yet; rebuild from the auction.
+    if (lot_frames.json)
+      send(conn, lot_frames);
+    else
+      send(conn, LotQueue::announce(auction, auction.lot_number()));
+    if (bid_frames.json)
+      send(conn, bid_frames);
+    else if (auction.has_bids())
+      send(conn, Message(Opcode::BidAccepted)
+                     .set(Field::Lot, auction.lot_number())
+                     .set(Field::Team, auction.high_bidder())
+                     .set(Field::Amount, auction.high_bid())
+                     .set(Field::NextBid, auction.next_bid()));
+  }
+
+private:
+  void queue(const std::shared_ptr<ConnOutbox> &outbox, const Frames &frames,
+             std::uint64_t coalesce_key = 0) {
+    if (outbox->push(frames, coalesce_key))
+      ready_.push_back(outbox);
+  }
+
+  // Outboxes with frames queued since the current Lock was taken.
+  std::vector<std::shared_ptr<ConnOutbox>> ready_;
 };
 
+void close_lot(Room &room, const char *closedBy);
+void record_results(Room &room, const std::vector<ResultsStore::Row> &rows);
+
+// Journals an event for room; `fields` are written after the room id and
+// sequence number. Caller must hold a Lock.
+template <typename Fields>
+void record_event(Room &room, EventType type, Fields &&fields) {
+  Record record(type);
+  record.text(room.id).number(static_cast<std::int64_t>(++room.journal_seq));
+  fields(record);
+  eventLog.append(record);
+}
+
+void record_event(Room &room, EventType type) {
+  record_event(room, type, [](Record &) {});
+}
+
+// The room's full state as one snapshot record. Caller must hold a Lock.
+Record snapshot_room(Room &room) {
+  Record record(EventType::RoomSnapshot);
+  record.text(room.id).number(static_cast<std::int64_t>(room.journal_seq));
+  record.number(room.players.count());
+  for (Players::Slot slot = 0; slot < room.players.size(); ++slot) {
+    if (room.players.vacant(slot))
+      continue;
+    const Player &player = room.players[slot];
+    record.text(player.username).text(player.team);
+    record.text(role_name(player.role));
+  }
+  record.number(static_cast<std::int64_t>(room.roster.version()));
+
+  const Auction &auction = room.auction;
+  record.number(static_cast<int>(auction.status));
+  record.number(static_cast<std::int64_t>(auction.lot_number()));
+  record.number(auction.bid_count());
+  for (const BidRecord &bid : auction.bids())
+    record.text(auction.teams()[bid.team]).number(bid.amount.lakhs());
+  record.number(static_cast<std::int64_t>(auction.sales().size()));
+  for (const Sale &sale : auction.sales()) {
+    record.text(auction.teams()[sale.team]).number(sale.player);
+    record.number(sale.lot).number(sale.price.lakhs());
+  }
+  record.number(static_cast<std::int64_t>(auction.plan_seed()));
+  return record;
+}
+
+// Applies one snapshot or journal record during startup recovery.
+void replay_event(RoomDirectory<Room> &rooms, const Catalog &catalog,
+                  const std::vector<std::string> &setOrder,
+                  RecordReader &in) {
+  std::string roomId = in.text();
+  auto seq = static_cast<std::uint64_t>(in.number());
+  if (!in.ok())
+    return;
+  if (in.type() == EventType::RoomClosed) {
+    rooms.erase(roomId);
+    return;
+  }
+  auto room = rooms.find(roomId);
+  if (!room) {
+    room = rooms.create(roomId);
+    room->id = roomId;
+  }
+  Room::Lock lock(*room);
+  if (seq <= room->journal_seq)
+    return;
+  room->journal_seq = seq;
+
+  Players &players = room->players;
+  Auction &auction = room->auction;
+  switch (in.type()) {
+  case EventType::RoomCreated:
+  case EventType::RoomClosed:
+    break;
+  case EventType::PlayerJoined: {
+    std::string username = in.text();
+    std::string_view team = auction.intern_team(in.text());
+    Role role = role_for(in.text());
+    Players::Slot slot = players.join(username, team, role);
+    players[slot].team = team;
+    players[slot].role = role;
+    room->roster.join(slot, players[slot]);
+    break;
+  }
+  case EventType::Renamed: {
+    std::string oldUsername = in.text();
+    std::string newUsername = in.text();
+    Players::Slot slot = players.find(oldUsername);
+    if (slot != Players::kNoSlot && players.rename(slot, newUsername))
+      room->roster.rename(slot, oldUsername, players[slot]);
+    break;
+  }
+  case EventType::PlayerLeft: {
+    Players::Slot slot = players.find(in.text());
+    if (slot == Players::kNoSlot)
+      break;
+    std::string username(players[slot].username);
+    players.remove(slot);
+    room->roster.leave(slot, username);
+    break;
+  }
+  case EventType::TeamChanged: {
+    std::string username = in.text();
+    std::string_view team = auction.intern_team(in.text());
+    Players::Slot slot = players.find(username);
+    if (slot == Players::kNoSlot)
+      break;
+    players[slot].team = team;
+    room->roster.change_team(slot, players[slot]);
+    break;
+  }
+  case EventType::AuctionStarted: {
+    auto seed = static_cast<std::uint64_t>(in.number());
+    auction.start(catalog, plan_lots(catalog, setOrder, seed));
+    room->lots.clear();
+    break;
+  }
+  case EventType::BidPlaced: {
+    std::string team = in.text();
+    auto amount = static_cast<std::int32_t>(in.number());
+    auction.place_bid(team, Money::lakhs(amount));
+    break;
+  }
+  case EventType::LotClosed: {
+    bool open = auction.has_lot();
+    auto result = auction.close_lot();
+    if (open)
+      record_results(*room, {ResultsStore::Row{result.player, result.team,
+                                               result.price, result.bids}});
+    break;
+  }
+  case EventType::RoomSnapshot: {
+    auto count = static_cast<Players::Slot>(in.number());
+    for (Players::Slot i = 0; i < count && in.ok(); ++i) {
+      std::string username = in.text();
+      std::string_view team = auction.intern_team(in.text());
+      Role role = role_for(in.text());
+      Players::Slot slot = players.join(username, team, role);
+      players[slot].team = team;
+      players[slot].role = role;
+      room->roster.join(slot, players[slot]);
+    }
+    room->roster.restore(static_cast<std::uint64_t>(in.number()));
+
+    auto status = static_cast<Auction::Status>(in.number());
+    auto lot = static_cast<std::size_t>(in.number());
+    if (status != Auction::Status::TeamSelection) {
+      // The plan's seed and the sales come after the open lot's bids in the
+      // record, but the bids are checked against the squads the sales build
+      // and the lot depends on both, so read everything first.
+      std::vector<std::pair<std::string, std::int32_t>> bids;
+      auto count = in.number();
+      for (std::int64_t i = 0; i < count && in.ok(); ++i) {
+        std::string team = in.text();
+        bids.emplace_back(team, static_cast<std::int32_t>(in.number()));
+      }
+      std::vector<std::pair<std::string, Sale>> sales;
+      count = in.number();
+      for (std::int64_t i = 0; i < count && in.ok(); ++i) {
+        std::string team = in.text();
+        Sale sale{};
+        sale.player = static_cast<std::uint32_t>(in.number());
+        sale.lot = static_cast<std::uint32_t>(in.number());
+        sale.price = Money::lakhs(static_cast<std::int32_t>(in.number()));
+        sales.emplace_back(team, sale);
+      }
+      auto seed = static_cast<std::uint64_t>(in.number());
+
+      auction.resume(catalog, plan_lots(catalog, setOrder, seed),
+                     Auction::Status::InProgress);
+      room->lots.clear();
+      for (const auto &[team, sale] : sales)
+        auction.restore_sale(team, sale.player, sale.lot, sale.price);
+      auction.seek(lot);
+      for (const auto &bid : bids)
+        auction.place_bid(bid.first, Money::lakhs(bid.second));
+      auction.status = status;
+
+      // Rebuild the room's closed lots from the plan and the sales, which
+      // are in lot order. Snapshots keep no bid counts for closed lots.
+      std::vector<ResultsStore::Row> rows;
+      auto sale = auction.sales().begin();
+      for (std::size_t l = 1; l < auction.lot_number(); ++l) {
+        ResultsStore::Row row{auction.player_at(l), {}, Money(), 0};
+        if (sale != auction.sales().end() && sale->lot == l) {
+          row.team = auction.teams()[sale->team];
+          row.price = sale->price;
+          ++sale;
+        }
+        rows.push_back(std::move(row));
+      }
+      record_results(*room, rows);
+    }
+    break;
+  }
+  }
+}
+
+void arm_lot_timer(Room &room) {
+  std::weak_ptr<Room> weak = room.weak_from_this();
+  std::size_t lotNumber = room.auction.lot_number();
+  room.lot_timer = lotTimers.schedule(
+      room.lot_deadline - std::chrono::steady_clock::now(), [weak, lotNumber] {
+        auto room = weak.lock();
+        if (!room)
+          return;
+        Room::Lock lock(*room);
+        if (room->auction.status != Auction::Status::InProgress ||
+            room->auction.lot_number() != lotNumber)
+          return;
+        if (std::chrono::steady_clock::now() < room->lot_deadline) {
+          arm_lot_timer(*room);
+          return;
+        }
+        close_lot(*room, "timer");
+      });
+}
+
+// Starts the reconnect grace for a player whose last connection closed. A
+// reconnect erases the room.leaving entry; a later disconnect pushes its
+// deadline out, and the earlier timer then finds it not yet due. Caller must
+// hold a Lock.
+void schedule_expiry(Room &room, Players::Slot slot) {
+  room.leaving[slot] = std::chrono::steady_clock::now() + reconnectGrace;
+  std::weak_ptr<Room> weak = room.weak_from_this();
+  lotTimers.schedule(reconnectGrace, [weak, slot] {
+    auto room = weak.lock();
+    if (!room)
+      return;
+    Room::Lock lock(*room);
+    auto it = room->leaving.find(slot);
+    if (it == room->leaving.end() ||
+        std::chrono::steady_clock::now() < it->second)
+      return;
+    room->leaving.erase(it);
+    if (room->players.online(slot))
+      return;
+    std::string username(room->players[slot].username);
+    record_event(*room, EventType::PlayerLeft,
+                 [&](Record &r) { r.text(username); });
+    room->players.remove(slot);
+    if (auto *delta = room->roster.leave(slot, username))
+      room->broadcast(delta->frames);
+    metrics.add(playersExpired);
+  });
+}
+
+// Frees every room no player is connected to whose auction is over, or that
+// has been idle for idleRoomTimeout (spectatedRoomTimeout if spectators are
+// watching), then re-arms itself. Spectators of a freed room are sent a
+// last frame and disconnected.
+void reap_rooms(RoomDirectory<Room> &rooms) {
+  auto now = std::chrono::steady_clock::now();
+  rooms.for_each([&](const std::string &roomId,
+                     const std::shared_ptr<Room> &room) {
+    {
+      Room::Lock lock(*room);
+      if (!room->players.connections().empty())
+        return;
+      bool over = room->auction.status == Auction::Status::Completed ||
+                  room->auction.status == Auction::Status::Cancelled;
+      auto timeout = room->spectators->size() != 0 ? spectatedRoomTimeout
+                                                   : idleRoomTimeout;
+      if (!over && now - room->idle_since < timeout)
+        return;
+      lotTimers.cancel(room->lot_timer);
+      record_event(*room, EventType::RoomClosed);
+      room->closed = true;
+    }
+    rooms.erase(roomId);
+    room->spectators->close_all(encode(
+        Message(Opcode::Error).set(Field::Message, "This room has closed")));
+    metrics.add(roomsReaped);
+    CROW_LOG_DEBUG << "Reaped room " << roomId;
+  });
+  lotTimers.schedule(reapInterval, [&rooms] { reap_rooms(rooms); });
+}
+
+// Announces the lot now open for bidding, or the end of the auction.
+// Caller must hold room.mutex.
+void announce_lot(Room &room) {
+  if (!room.auction.has_lot()) {
+    Frames frames = encode(Message(Opcode::AuctionComplete));
+    room.broadcast(frames);
+    room.publish_lot(frames);
+    return;
+  }
+  room.lot_deadline = std::chrono::steady_clock::now() + bidTimeout;
+  arm_lot_timer(room);
+  Frames frames = room.lots.open(room.auction);
+  room.broadcast(frames);
+  room.publish_lot(frames);
+}
+
+// Adds closed lots to the room's results and the server-wide ones.
+void record_results(Room &room, const std::vector<ResultsStore::Row> &rows) {
+  const Catalog &catalog = room.auction.catalog();
+  room.results.append(catalog, rows);
+  allResults.append(catalog, rows);
+}
+
+// Closes the open lot, announces SOLD/UNSOLD and opens the next one.
+// Caller must hold room.mutex.
+void close_lot(Room &room, const char *closedBy) {
+  lotTimers.cancel(room.lot_timer);
+  std::size_t lotNumber = room.auction.lot_number();
+  auto result = room.auction.close_lot();
+  record_event(room, EventType::LotClosed);
+  const Catalog &catalog = room.auction.catalog();
+  record_results(room, {ResultsStore::Row{result.player, result.team,
+                                          result.price, result.bids}});
+  Frames frames =
+      encode(Message(Opcode::LotClosed)
+                 .set(Field::Lot, lotNumber)
+                 .set(Field::Name, catalog.name(result.player))
+                 .set(Field::Result, result.sold() ? "SOLD" : "UNSOLD")
+                 .set(Field::Team, result.team)
+                 .set(Field::Amount, result.price)
+                 .set(Field::Bids, result.bids)
+                 .set(Field::ClosedBy, closedBy));
+  room.broadcast(frames);
+  room.publish_lot(frames);
+  announce_lot(room);
+}
+
+// Reads ?by= (team if absent); false if it names no grouping.
+bool results_group_by(const crow::request &req, ResultsStore::GroupBy &by) {
+  by = ResultsStore::GroupBy::Team;
+  const char *param = req.url_params.get("by");
+  return !param || group_by_for(param, by);
+}
+
+crow::response results_bad_group() {
+  crow::json::wvalue error_response;
+  error_response["message"] = "by must be team, set, role or country";
+  crow::response res;
+  res.code = 400;
+  res.write(error_response.dump());
+  return res;
+}
+
+// Answers a /results query: one entry per group of `totals`, amounts in
+// crores, over `lots` lots. `partial` marks an answer missing a worker's
+// share. With `raw` the sums are also given in lakhs, for a peer to merge.
+crow::response results_response(ResultsStore::GroupBy by, std::size_t lots,
+                                const std::vector<ResultsStore::Totals> &totals,
+                                bool partial = false, bool raw = false) {
+  crow::json::wvalue::list groups;
+  for (const auto &sums : totals) {
+    crow::json::wvalue group(
+        {{"group", sums.group},
+         {"lots", sums.lots},
+         {"sold", sums.sold},
+         {"unsoldRate", sums.unsold_rate()},
+         {"spent", sums.price_lakhs / 100.0},
+         {"basePrice", sums.base_lakhs / 100.0},
+         {"premium", sums.premium()}});
+    if (raw) {
+      group["spentLakhs"] = sums.price_lakhs;
+      group["basePriceLakhs"] = sums.base_lakhs;
+    }
+    groups.push_back(std::move(group));
+  }
+  crow::json::wvalue x(
+      {{"by", group_by_name(by)}, {"lots", lots}, {"partial", partial}});
+  x["groups"] = std::move(groups);
+  crow::response res;
+  res.code = 200;
+  res.write(x.dump());
+  return res;
+}
+
+// Adds worker `index`'s share of the server-wide results to `totals`,
+// matching groups by name. False if the worker did not answer in time.
+bool merge_worker_results(unsigned index, ResultsStore::GroupBy by,
+                          std::vector<ResultsStore::Totals> &totals,
+                          std::size_t &lots) {
+  HttpResult reply = http_get(
+      peer_worker(index),
+      std::string("/results?scope=worker&by=") + group_by_name(by),
+      peerTimeout);
+  auto json = reply.status == 200 ? crow::json::load(reply.body)
+                                  : crow::json::rvalue();
+  if (!json || !json.has("groups"))
+    return false;
+  lots += static_cast<std::size_t>(json["lots"].u());
+  for (const auto &group : json["groups"]) {
+    std::string name = group["group"].s();
+    auto it = std::find_if(totals.begin(), totals.end(),
+                           [&](const auto &t) { return t.group == name; });
+    if (it == totals.end()) {
+      totals.push_back(ResultsStore::Totals{name});
+      it = totals.end() - 1;
+    }
+    it->lots += group["lots"].u();
+    it->sold += group["sold"].u();
+    it->price_lakhs += group["spentLakhs"].i();
+    it->base_lakhs += group["basePriceLakhs"].i();
+  }
+  return true;
+}
+
+// Reads a JSON client request into the same Command a binary frame decodes
+// to, so the handlers dispatch on the opcode alone.
+Command decode_command(const crow::json::rvalue &json) {
+  Command cmd;
+  if (!json.has("type"))
+    return cmd;
+  cmd.op = protocol::opcode_for(std::string(json["type"].s()));
+  if (json.has("newUsername"))
+    cmd.text = json["newUsername"].s();
+  if (json.has("newTeam"))
+    cmd.text = json["newTeam"].s();
+  if (json.has("amount")) {
+    cmd.amount = Money::from_crores(json["amount"].d());
+    cmd.has_amount = true;
+  }
+  if (json.has("ref"))
+    cmd.ref = json["ref"].i();
+  return cmd;
+}
+
 std::string generate_username() {
 
   static const std::vector<std::string> firstNames = {
@@ -89,23 +829,112 @@ std::string generate_username() {
       "McCullum",    "Vettori",    "Al Hasan",     "Rahim",      "Iqbal",
       "Mortaza",     "Kumble",     "Gavaskar",     "Dev",        "Gambhir",
       "Bhajji",      "Khan"};
-  static std::mt19937 rng(std::time(nullptr));
-  std::uniform_int_distribution<std::size_t> firstNameDist(
-      0, firstNames.size() - 1);
-  std::uniform_int_distribution<std::size_t> lastNameDist(0,
-                                                          lastNames.size() - 1);
+  FastRng &rng = thread_rng();
 
-  std::string firstName = firstNames[firstNameDist(rng)];
-  std::string lastName = lastNames[lastNameDist(rng)];
+  const std::string &firstName = firstNames[rng.below(firstNames.size())];
+  const std::string &lastName = lastNames[rng.below(lastNames.size())];
 
   return firstName + " " + lastName;
 }
 
-int main() {
+// Adds a player under a generated username nobody in the room has, offline
+// until their socket connects (and dropped like any offline player if it
+// never does). Caller must hold a Lock.
+Players::Slot reserve_player(Room &room, Role role) {
+  std::string username = generate_username();
+  // Past a few redraws the room is crowded; a suffix always resolves it.
+  for (int attempt = 2; room.players.find(username) != Players::kNoSlot;
+       ++attempt)
+    username = attempt < 8
+                   ? generate_username()
+                   : generate_username() + " " + std::to_string(attempt);
+  Players::Slot slot = room.players.join(
+      username, room.auction.intern_team("observer"), role);
+  schedule_expiry(room, slot);
+  return slot;
+}
+
+// LOG_LEVEL=debug|info|warning|error|critical; INFO when unset.
+crow::LogLevel log_level(const char *name) {
+  std::string level = name ? name : "";
+  if (level == "debug")
+    return crow::LogLevel::Debug;
+  if (level == "warning")
+    return crow::LogLevel::Warning;
+  if (level == "error")
+    return crow::LogLevel::Error;
+  if (level == "critical")
+    return crow::LogLevel::Critical;
+  return crow::LogLevel::Info;
+}
+
+// Whether roomId is a live room. A room another worker owns is looked up
+// on that worker, so a token for it still counts in /create-room and
+// /join-room whichever worker the request reached; a worker that does not
+// answer within peerTimeout counts as not having it.
+bool room_exists(const RoomDirectory<Room> &rooms, const std::string &roomId) {
+  unsigned owner = cluster::owner(roomId, workerCount);
+  if (owner == workerIndex)
+    return rooms.contains(roomId);
+  int status = http_get(peer_worker(owner), "/rooms/" + roomId, peerTimeout)
+                   .status;
+  if (status == 0)
+    CROW_LOG_WARNING << "Worker " << owner << " did not answer for room "
+                     << roomId;
+  return status == 200;
+}
+
+// Runs one app on `port` serving the rooms this worker owns.
+int serve(int port) {
+  if (workerCount > 1)
+    eventLog.set_directory("journal/" + std::to_string(workerIndex));
+  AsyncLogHandler logHandler;
+  crow::logger::setHandler(&logHandler);
   crow::App<crow::CORSHandler, crow::CookieParser> app;
-  std::unordered_map<std::string, Room> wsrooms;
-  std::unordered_map<crow::websocket::connection *, ConnData> connections;
-  std::mutex rooms_mutex;
+  app.loglevel(log_level(std::getenv("LOG_LEVEL")));
+  RoomDirectory<Room> wsrooms;
+  Auth auth(jwtSecret, domain);
+  const Catalog catalog = Catalog::load("Auction_List.csv");
+  // Sets in CATEGORY_ORDER, or every set in file order.
+  const std::vector<std::string> setOrder = read_category_order(".env");
+
+  auto recoveryStart = std::chrono::steady_clock::now();
+  std::size_t replayed = eventLog.recover([&](RecordReader &in) {
+    replay_event(wsrooms, catalog, setOrder, in);
+  });
+  wsrooms.for_each([](const std::string &, const std::shared_ptr<Room> &room) {
+    Room::Lock lock(*room);
+    if (room->auction.status == Auction::Status::InProgress &&
+        room->auction.has_lot()) {
+      room->lot_deadline = std::chrono::steady_clock::now() + bidTimeout;
+      arm_lot_timer(*room);
+    }
+    // Everyone is offline after a restart; give them the usual grace.
+    for (Players::Slot slot = 0; slot < room->players.size(); ++slot) {
+      if (!room->players.vacant(slot))
+        schedule_expiry(*room, slot);
+    }
+  });
+  CROW_LOG_INFO << "Recovered " << wsrooms.size() << " rooms from "
+                << replayed << " journal records in "
+                << std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::steady_clock::now() - recoveryStart)
+                       .count()
+                << "ms";
+  eventLog.start([&](const EventLog::Sink &sink) {
+    wsrooms.for_each(
+        [&](const std::string &, const std::shared_ptr<Room> &room) {
+          std::optional<Record> record;
+          {
+            Room::Lock lock(*room);
+            if (!room->closed)
+              record = snapshot_room(*room);
+          }
+          if (record)
+            sink(*record);
+        });
+  });
+  lotTimers.schedule(reapInterval, [&wsrooms] { reap_rooms(wsrooms); });
 
   auto &cors = app.get_middleware<crow::CORSHandler>();
 
@@ -118,58 +947,155 @@ int main() {
 
   CROW_ROUTE(app, "/")([]() { return "Hello world"; });
 
+  // This worker's metrics, every series labelled worker="<index>" in
+  // multi-process mode.
+  auto render_metrics = [&wsrooms, &logHandler, &auth]() {
+    std::string worker =
+        workerCount > 1 ? "worker=\"" + std::to_string(workerIndex) + "\""
+                        : "";
+    std::string labels = worker.empty() ? "" : "{" + worker + "}";
+    std::ostringstream out;
+    auto metric = [&](const char *name, const char *type, auto value) {
+      out << "# TYPE " << name << " " << type << "\n"
+          << name << labels << " " << value << "\n";
+    };
+    metrics.write(out, worker);
+    metric("rooms", "gauge", wsrooms.size());
+    metric("room_heap_allocations_total", "counter", roomHeap.allocations());
+    metric("room_heap_bytes", "gauge", roomHeap.bytes());
+    metric("ws_connections", "gauge",
+           metrics.total(connectionsOpened) - metrics.total(connectionsClosed));
+    metric("spectators", "gauge",
+           metrics.total(spectatorsJoined) - metrics.total(spectatorsLeft));
+    metric("spectator_deliveries_total", "counter",
+           spectatorHub.deliveries());
+    metric("outbox_queued_frames", "gauge", outboxMetrics.queued_frames.load());
+    metric("outbox_queued_bytes", "gauge", outboxMetrics.queued_bytes.load());
+    metric("outbox_sent_frames_total", "counter",
+           outboxMetrics.sent_frames.load());
+    metric("outbox_coalesced_total", "counter", outboxMetrics.coalesced.load());
+    metric("outbox_dropped_total", "counter", outboxMetrics.dropped.load());
+    metric("outbox_evictions_total", "counter", outboxMetrics.evictions.load());
+    metric("outbox_paced_total", "counter", outboxMetrics.paced.load());
+    EventLog::Stats journal = eventLog.stats();
+    metric("journal_records_total", "counter", journal.records);
+    metric("journal_commits_total", "counter", journal.commits);
+    metric("journal_bytes_total", "counter", journal.bytes);
+    metric("journal_snapshots_total", "counter", journal.snapshots);
+    metric("log_dropped_lines_total", "counter", logHandler.dropped());
+    metric("jwt_cache_hits_total", "counter", auth.hits());
+    metric("jwt_cache_misses_total", "counter", auth.misses());
+    metric("results_rows", "gauge", allResults.size());
+    crow::response res(out.str());
+    res.set_header("Content-Type", "text/plain; version=0.0.4");
+    return res;
+  };
+
+  // With several workers each is scraped on its own path, /metrics/<index>,
+  // which the router always sends to that worker; plain /metrics would
+  // reach a different worker on each scrape.
+  CROW_ROUTE(app, "/metrics")([&render_metrics]() {
+    if (workerCount > 1)
+      return crow::response(
+          404, "Scrape each worker at /metrics/0 to /metrics/" +
+                   std::to_string(workerCount - 1) + "\n");
+    return render_metrics();
+  });
+
+  CROW_ROUTE(app, "/metrics/<uint>")
+  ([&render_metrics](std::uint64_t index) {
+    if (index != workerIndex)
+      return crow::response(404);
+    return render_metrics();
+  });
+
+  // Server-wide results. In multi-process mode the worker the router picked
+  // asks every other worker for its share (?scope=worker) and merges them,
+  // so any worker gives the same answer; a worker that does not answer
+  // within peerTimeout is left out and the answer marked partial.
+  CROW_ROUTE(app, "/results")([&catalog](const crow::request &req) {
+    ResultsStore::GroupBy by;
+    if (!results_group_by(req, by))
+      return results_bad_group();
+    auto totals = allResults.totals(by, catalog);
+    std::size_t lots = allResults.size();
+    const char *scope = req.url_params.get("scope");
+    if (scope && std::string(scope) == "worker")
+      return results_response(by, lots, totals, false, true);
+    bool partial = false;
+    for (unsigned i = 0; i < workerCount; ++i) {
+      if (i != workerIndex && !merge_worker_results(i, by, totals, lots))
+        partial = true;
+    }
+    return results_response(by, lots, totals, partial);
+  });
+
+  CROW_ROUTE(app, "/results/<string>")
+  ([&wsrooms, &catalog](const crow::request &req, std::string roomId) {
+    ResultsStore::GroupBy by;
+    if (!results_group_by(req, by))
+      return results_bad_group();
+    auto room = wsrooms.find(roomId);
+    if (!room) {
+      crow::json::wvalue error_response;
+      error_response["message"] = "Room does not exist";
+      crow::response res;
+      res.code = 404;
+      res.write(error_response.dump());
+      return res;
+    }
+    return results_response(by, room->results.size(),
+                            room->results.totals(by, catalog));
+  });
+
+  // 200 if the room is live on this worker, 404 if not.
+  CROW_ROUTE(app, "/rooms/<string>")
+  ([&wsrooms](const std::string &roomId) {
+    return crow::response(wsrooms.contains(roomId) ? 200 : 404);
+  });
+
   CROW_ROUTE(app, "/create-room")
       .methods(
-          crow::HTTPMethod::POST)([&app, &wsrooms](const crow::request &req) {
+          crow::HTTPMethod::POST)([&app, &wsrooms,
+                                   &auth](const crow::request &req) {
         auto &ctx = app.get_context<crow::CookieParser>(req);
         auto token_cookie = ctx.get_cookie("token");
         crow::response res;
         if (!token_cookie.empty()) {
-          try {
-            auto decoded = jwt::decode(token_cookie);
-            auto verifier =
-                jwt::verify()
-                    .allow_algorithm(jwt::algorithm::hs256{jwtSecret})
-                    .with_issuer(domain);
-            verifier.verify(decoded);
-            auto usernameClaim = decoded.get_payload_claim("username");
-            auto roomIdClaim = decoded.get_payload_claim("room-id");
-            auto roleClaim = decoded.get_payload_claim("role");
-
-            if (wsrooms.find(roomIdClaim.as_string()) != wsrooms.end()) {
-
-              crow::json::wvalue x(
-                  {{"room-id", roomIdClaim.as_string()},
-                   {"message", "Currently participating in another auction!"},
-                   {"username", usernameClaim.as_string()},
-                   {"role", roleClaim.as_string()}});
-              res.code = 200;
-              res.write(x.dump());
-              return res;
-            }
-          } catch (const std::exception &e) {
+          auto verifyStart = Metrics::Clock::now();
+          auto claims = auth.verify(token_cookie);
+          metrics.observe(jwtVerifyTime, Metrics::Clock::now() - verifyStart);
+          if (claims && room_exists(wsrooms, claims->roomId)) {
+            crow::json::wvalue x(
+                {{"room-id", claims->roomId},
+                 {"message", "Currently participating in another auction!"},
+                 {"username", claims->username},
+                 {"role", claims->role}});
+            res.code = 200;
+            res.write(x.dump());
+            return res;
           }
         }
 
-        std::string roomId = generateRoomId();
-        std::string leaderUsername = generate_username();
-        auto token =
-            jwt::create()
-                .set_issuer(domain)
-                .set_type("JWT")
-                .set_issued_now()
-                .set_payload_claim("username",
-                                   jwt::claim(std::string(leaderUsername)))
-                .set_payload_claim("room-id", jwt::claim(std::string(roomId)))
-                .set_payload_claim("role", jwt::claim(std::string("leader")))
-                .sign(jwt::algorithm::hs256{jwtSecret});
+        std::string roomId;
+        std::shared_ptr<Room> room;
+        do {
+          roomId = generateRoomId();
+          room = wsrooms.create(roomId);
+        } while (!room);
+        std::string leaderUsername;
+        {
+          Room::Lock lock(*room);
+          room->id = roomId;
+          record_event(*room, EventType::RoomCreated);
+          leaderUsername = room->players[reserve_player(*room, Role::Leader)]
+                               .username;
+        }
+        auto token = auth.sign({leaderUsername, roomId, "leader"});
         crow::json::wvalue x({{"room-id", roomId},
                               {"message", "Room created!"},
                               {"username", leaderUsername},
                               {"role", "leader"}});
-        Player p;
-        p.username = leaderUsername;
-        p.role = "leader";
         res.code = 200;
         res.write(x.dump());
         ctx.set_cookie("token", token)
@@ -177,46 +1103,43 @@ int main() {
             .same_site(crow::CookieParser::Cookie::SameSitePolicy::Lax)
             //.secure()
             .httponly();
-        wsrooms[roomId] = Room{};
         CROW_LOG_INFO << "Room created: " << roomId;
-        CROW_LOG_INFO << "players.size(): " << wsrooms[roomId].players.size();
         return res;
       });
 
   CROW_ROUTE(app, "/join-room/<string>")
       .methods(
-          crow::HTTPMethod::POST)([&wsrooms, &app](const crow::request &req,
-                                                   std::string roomId) {
+          crow::HTTPMethod::POST)([&wsrooms, &app,
+                                   &auth](const crow::request &req,
+                                          std::string roomId) {
         auto &ctx = app.get_context<crow::CookieParser>(req);
         auto token_cookie = ctx.get_cookie("token");
         if (!token_cookie.empty()) {
-          try {
-            auto decoded = jwt::decode(token_cookie);
-            auto verifier =
-                jwt::verify()
-                    .allow_algorithm(jwt::algorithm::hs256{jwtSecret})
-                    .with_issuer(domain);
-            verifier.verify(decoded);
-            auto usernameClaim = decoded.get_payload_claim("username");
-            auto roomIdClaim = decoded.get_payload_claim("room-id");
-            auto roleClaim = decoded.get_payload_claim("role");
-
-            if (wsrooms.find(roomIdClaim.as_string()) != wsrooms.end()) {
-              crow::json::wvalue x(
-                  {{"room-id", roomIdClaim.as_string()},
-                   {"message", "Currently participating in another auction!"},
-                   {"username", usernameClaim.as_string()},
-                   {"role", roleClaim.as_string()}});
-              crow::response res;
-              res.code = 200;
-              res.write(x.dump());
-              return res;
-            }
-          } catch (const std::exception &e) {
+          auto verifyStart = Metrics::Clock::now();
+          auto claims = auth.verify(token_cookie);
+          metrics.observe(jwtVerifyTime, Metrics::Clock::now() - verifyStart);
+          if (claims && room_exists(wsrooms, claims->roomId)) {
+            crow::json::wvalue x(
+                {{"room-id", claims->roomId},
+                 {"message", "Currently participating in another auction!"},
+                 {"username", claims->username},
+                 {"role", claims->role}});
+            crow::response res;
+            res.code = 200;
+            res.write(x.dump());
+            return res;
           }
         }
 
-        if (wsrooms.find(roomId) == wsrooms.end()) {
+        auto room = wsrooms.find(roomId);
+        std::string playerName;
+        if (room) {
+          Room::Lock lock(*room);
+          if (!room->closed)
+            playerName =
+                room->players[reserve_player(*room, Role::Player)].username;
+        }
+        if (playerName.empty()) {
           crow::json::wvalue error_response;
           error_response["message"] = "Room does not exist";
           crow::response res;
@@ -224,24 +1147,11 @@ int main() {
           res.write(error_response.dump());
           return res;
         }
-        std::string playerName = generate_username();
         crow::json::wvalue x({{"room-id", roomId},
                               {"username", playerName},
                               {"message", "Welcome to the auction!"},
                               {"role", "player"}});
-        auto token =
-            jwt::create()
-                .set_issuer(domain)
-                .set_type("JWT")
-                .set_issued_now()
-                .set_payload_claim("username",
-                                   jwt::claim(std::string(playerName)))
-                .set_payload_claim("room-id", jwt::claim(std::string(roomId)))
-                .set_payload_claim("role", jwt::claim(std::string("player")))
-                .sign(jwt::algorithm::hs256{jwtSecret});
-        Player p;
-        p.username = playerName;
-        p.role = "player";
+        auto token = auth.sign({playerName, roomId, "player"});
         crow::response res;
         res.code = 200;
         res.write(x.dump());
@@ -253,9 +1163,163 @@ int main() {
         return res;
       });
 
+  // Applies one queued client command. Runs on whichever thread is
+  // draining the room's queue, under its Lock. The sender may have closed
+  // since it sent the command: its connection is only compared against,
+  // and replies go to its outbox, which drops them once closed.
+  auto apply = [&](Room &room, const RoomCommand &item) {
+    const Command &cmd = item.cmd;
+    Metrics::Timer timer(metrics, handler_time(cmd.op));
+
+    switch (cmd.op) {
+    case Opcode::ChangeUsername: {
+      const std::string &newUsername = cmd.text;
+      std::string oldUsername(room.players[item.slot].username);
+      if (!room.players.rename(item.slot, newUsername)) {
+        room.send(item.outbox, Message(Opcode::Error)
+                                   .set(Field::Message,
+                                        "That username is already taken"));
+        return;
+      }
+      record_event(room, EventType::Renamed, [&](Record &r) {
+        r.text(oldUsername).text(newUsername);
+      });
+      room.send(item.outbox, Message(Opcode::YourUsername)
+                                 .set(Field::Username, newUsername));
+      if (auto *delta = room.roster.rename(item.slot, oldUsername,
+                                           room.players[item.slot]))
+        room.broadcast(delta->frames, item.conn);
+      break;
+    }
+    case Opcode::ChangeTeam: {
+      const std::string &newTeam = cmd.text;
+      const StringPool &teams = room.auction.teams();
+      if (teams.size() >= kMaxTeams && teams.find(newTeam) == teams.size()) {
+        room.send(item.outbox, Message(Opcode::Error)
+                                   .set(Field::Message, "Too many teams"));
+        return;
+      }
+      Player &player = room.players[item.slot];
+      player.team = room.auction.intern_team(newTeam);
+      record_event(room, EventType::TeamChanged, [&](Record &r) {
+        r.text(player.username).text(newTeam);
+      });
+      room.send(item.outbox,
+                Message(Opcode::YourTeam).set(Field::Team, newTeam));
+      if (auto *delta = room.roster.change_team(item.slot, player))
+        room.broadcast(delta->frames, item.conn,
+                       coalesce_key(Opcode::TeamChange, item.slot));
+      break;
+    }
+    case Opcode::StartAuction: {
+      if (room.players[item.slot].role != Role::Leader ||
+          room.auction.status != Auction::Status::TeamSelection) {
+        room.send(item.outbox,
+                  Message(Opcode::Error)
+                      .set(Field::Message,
+                           "Only the leader can start the auction"));
+        return;
+      }
+      // Each room draws its own lot order; the seed journals it.
+      std::uint64_t seed = thread_rng()();
+      room.auction.start(catalog, plan_lots(catalog, setOrder, seed));
+      room.lots.clear();
+      record_event(room, EventType::AuctionStarted, [&](Record &r) {
+        r.number(static_cast<std::int64_t>(seed));
+      });
+      announce_lot(room);
+      break;
+    }
+    case Opcode::PlaceBid: {
+      if (!cmd.has_amount)
+        return;
+
+      const Player &player = room.players[item.slot];
+      const char *rejection = nullptr;
+      if (player.team == "observer") {
+        rejection = "Join a team to bid";
+      } else {
+        auto result = room.auction.place_bid(player.team, cmd.amount);
+        if (result != Auction::BidResult::Accepted)
+          rejection = bid_result_reason(result);
+      }
+      if (rejection) {
+        room.send(item.outbox,
+                  Message(Opcode::BidRejected)
+                      .set(Field::Reason, rejection)
+                      .set(Field::NextBid, room.auction.next_bid())
+                      .set(Field::MaxBid, room.auction.max_bid(player.team))
+                      .set(Field::Ref, cmd.ref));
+        return;
+      }
+      record_event(room, EventType::BidPlaced, [&](Record &r) {
+        r.text(player.team).number(cmd.amount.lakhs());
+      });
+      room.lot_deadline = std::chrono::steady_clock::now() + bidTimeout;
+      Frames frames =
+          encode(Message(Opcode::BidAccepted)
+                     .set(Field::Lot, room.auction.lot_number())
+                     .set(Field::Team, player.team)
+                     .set(Field::Username, player.username)
+                     .set(Field::Amount, room.auction.high_bid())
+                     .set(Field::NextBid, room.auction.next_bid())
+                     .set(Field::Ref, cmd.ref));
+      room.broadcast(frames);
+      room.publish_bid(frames);
+      break;
+    }
+    case Opcode::CloseLot: {
+      if (room.players[item.slot].role != Role::Leader ||
+          room.auction.status != Auction::Status::InProgress)
+        return;
+      close_lot(room, "leader");
+      break;
+    }
+    default:
+      break;
+    }
+  };
+
+  // Applies up to kDrainBatches of a room's queued commands. A room with
+  // more waiting goes to the back of commandExecutor's line, so it holds
+  // neither the io thread that pushed nor an executor thread for long.
+  std::function<void(const std::shared_ptr<Room> &)> drain_commands =
+      [&](const std::shared_ptr<Room> &room) {
+        bool more = room->commands.drain(
+            [&](std::vector<RoomCommand> &batch) {
+              for (std::size_t i = 0; i < batch.size(); i += kCommandBatch) {
+                std::size_t end = std::min(batch.size(), i + kCommandBatch);
+                metrics.observe(commandBatch, end - i);
+                Room::Lock lock(*room);
+                for (std::size_t j = i; j < end; ++j)
+                  apply(*room, batch[j]);
+              }
+            },
+            kDrainBatches);
+        if (more)
+          commandExecutor.post([&drain_commands, room] {
+            drain_commands(room);
+          });
+      };
+
   CROW_ROUTE(app, "/wsrooms")
       .websocket(&app)
       .onaccept([&](const crow::request &req, void **userdata) {
+        const char *format = req.url_params.get("format");
+        bool binary = format && std::string(format) == "binary";
+
+        // /wsrooms?spectate=<room id>: watch without a token or a seat.
+        if (const char *spectate = req.url_params.get("spectate")) {
+          auto room = wsrooms.find(spectate);
+          if (!room || room->spectators->size() >= kMaxSpectators) {
+            CROW_LOG_WARNING << "Spectator rejected for room " << spectate;
+            return false;
+          }
+          *userdata =
+              new ConnData{room, Players::kNoSlot, binary, 0, nullptr};
+          return true;
+        }
+
         auto &ctx = app.get_context<crow::CookieParser>(req);
         auto token_cookie = ctx.get_cookie("token");
 
@@ -264,56 +1328,59 @@ int main() {
           return false;
         }
 
-        try {
-          auto decoded = jwt::decode(token_cookie);
-          auto verifier = jwt::verify()
-                              .allow_algorithm(jwt::algorithm::hs256{jwtSecret})
-                              .with_issuer(domain);
-          verifier.verify(decoded);
+        std::string error;
+        auto verifyStart = Metrics::Clock::now();
+        auto claims = auth.verify(token_cookie, &error);
+        metrics.observe(jwtVerifyTime, Metrics::Clock::now() - verifyStart);
+        if (!claims) {
+          CROW_LOG_WARNING << "WebSocket rejected: JWT error - " << error;
+          return false;
+        }
 
-          std::string username =
-              decoded.get_payload_claim("username").as_string();
-          std::string roomId = decoded.get_payload_claim("room-id").as_string();
-          std::string role = decoded.get_payload_claim("role").as_string();
+        const std::string &username = claims->username;
+        const std::string &roomId = claims->roomId;
+        Role role = role_for(claims->role);
 
-          if (username.empty() || roomId.empty() || role.empty()) {
-            CROW_LOG_WARNING << "WebSocket rejected: Incomplete token payload";
-            return false;
-          }
+        if (username.empty() || roomId.empty() || claims->role.empty()) {
+          CROW_LOG_WARNING << "WebSocket rejected: Incomplete token payload";
+          return false;
+        }
 
-          std::lock_guard<std::mutex> lock(rooms_mutex);
-          if (wsrooms.find(roomId) == wsrooms.end()) {
+        auto room = wsrooms.find(roomId);
+        if (!room) {
+          CROW_LOG_WARNING << "WebSocket rejected: Room " << roomId
+                           << " not found";
+          return false;
+        }
+
+        Players::Slot slot;
+        bool returning;
+        {
+          Room::Lock lock(*room);
+          if (room->closed) {
             CROW_LOG_WARNING << "WebSocket rejected: Room " << roomId
-                             << " not found";
+                             << " closed";
             return false;
           }
-
-          Player player{username, "observer", role};
-
-          auto &room = wsrooms[roomId];
-          auto it = std::find_if(room.players.begin(), room.players.end(),
-                                 [&](const auto &entry) {
-                                   return entry.second.username == username;
-                                 });
-
-          if (it != room.players.end()) {
-            player.team = it->second.team;
-            CROW_LOG_INFO << "Returning player " << username << " with team "
-                          << player.team;
-          } else {
-            CROW_LOG_INFO << "New player " << username
-                          << " joining as observer";
-          }
-          ConnData *cd = new ConnData{roomId, player};
-          *userdata = cd;
-          CROW_LOG_INFO << "WebSocket accepted: " << username << " in room "
-                        << roomId;
-          return true;
-
-        } catch (const std::exception &e) {
-          CROW_LOG_WARNING << "WebSocket rejected: JWT error - " << e.what();
-          return false;
+          slot = room->players.find(username);
+          returning = slot != Players::kNoSlot;
+          if (returning) {
+            room->players[slot].role = role;
+            room->leaving.erase(slot);
+          } else
+            slot = room->players.join(
+                username, room->auction.intern_team("observer"), role);
         }
+        CROW_LOG_DEBUG << (returning ? "Returning player " : "New player ")
+                       << username;
+        const char *since = req.url_params.get("since");
+        ConnData *cd = new ConnData{
+            room, slot, binary,
+            since ? std::strtoull(since, nullptr, 10) : 0, nullptr};
+        *userdata = cd;
+        CROW_LOG_INFO << "WebSocket accepted: " << username << " in room "
+                      << roomId;
+        return true;
       })
       .onopen([&](crow::websocket::connection &conn) {
         auto *cd = static_cast<ConnData *>(conn.userdata());
@@ -324,118 +1391,161 @@ int main() {
           return;
         }
 
-        const std::string roomId = cd->roomId;
-        const Player player = cd->player;
-
-        CROW_LOG_INFO << "Assigned player successfully";
-        std::lock_guard<std::mutex> lock(rooms_mutex);
-
-        auto roomIt = wsrooms.find(roomId);
-        if (roomIt == wsrooms.end()) {
-          CROW_LOG_ERROR << "WebSocket open: Room " << roomId << " not found";
-          conn.close("Room not found");
-          delete cd;
+        metrics.add(connectionsOpened);
+        cd->outbox =
+            std::make_shared<ConnOutbox>(&conn, cd->binary, &outboxPacer);
+        Room &room = *cd->room;
+        if (cd->spectator()) {
+          metrics.add(spectatorsJoined);
+          if (room.spectators->add(&conn, cd->outbox))
+            spectatorHub.schedule(room.spectators);
           return;
         }
+        Room::Lock lock(room);
 
-        Room &room = roomIt->second;
-        room.players[&conn] = player;
-        room.connections.insert(&conn);
-        connections[&conn] = ConnData{roomId, player};
-
-        delete cd;
-
-        conn.send_text(crow::json::wvalue{
-            {"type", "Your Team"},
-            {"team",
-             player.team}}.dump());
-        crow::json::wvalue::list playerList;
-        CROW_LOG_INFO << "Collecting Player List";
-        for (const auto &[_, p] : room.players) {
-          if (p.username != player.username) {
-            playerList.push_back(crow::json::wvalue{
-                {"username", p.username}, {"team", p.team}, {"role", p.role}});
-          }
-        }
+        room.players.attach(cd->slot, &conn);
+        const Player &player = room.players[cd->slot];
 
-        try {
-          conn.send_text(crow::json::wvalue{
-              {"type", "Player List"},
-              {"list",
-               playerList}}.dump());
-          CROW_LOG_DEBUG << "Sent player list to " << player.username;
-        } catch (const std::exception &e) {
-          CROW_LOG_ERROR << "send_text failed: " << e.what();
-        }
+        room.send(conn,
+                  Message(Opcode::YourTeam).set(Field::Team, player.team));
 
-        for (auto *other : wsrooms[roomId].connections) {
-          if (other != &conn) {
-            other->send_text(crow::json::wvalue{
-                {"type", "New Player"},
-                {"username", player.username},
-                {"team", player.team},
-                {"role",
-                 player.role}}.dump());
-          }
+        // The joiner's own entry reaches it through the catch-up; everyone
+        // else gets the same delta frames as a broadcast.
+        const Roster::Delta *joined = room.roster.join(cd->slot, player);
+        room.roster.catch_up(cd->since, [&](const Frames &frames) {
+          room.send(conn, frames);
+        });
+        CROW_LOG_DEBUG << "Sent roster v" << room.roster.version() << " to "
+                       << player.username;
+        room.send_lot_state(conn);
+        if (joined) {
+          record_event(room, EventType::PlayerJoined, [&](Record &r) {
+            r.text(player.username).text(player.team);
+            r.text(role_name(player.role));
+          });
+          room.broadcast(joined->frames, &conn);
         }
       })
       .onmessage([&](crow::websocket::connection &conn,
                      const std::string &message, bool is_binary) {
-        auto json = crow::json::load(message);
-        if (!json)
+        auto *cd = static_cast<ConnData *>(conn.userdata());
+        if (!cd || cd->spectator())
           return;
 
-        std::string type = json["type"].s();
-        if (type == "Change Username") {
-          std::string newUsername = json["newUsername"].s();
-          std::lock_guard<std::mutex> lock(rooms_mutex);
-          auto it = connections.find(&conn);
-          if (it != connections.end()) {
-            ConnData &connData = it->second;
-            auto oldUsername = connData.player.username;
-            connData.player.username = newUsername;
-            wsrooms[connData.roomId].players[&conn].username = newUsername;
-            conn.send_text(crow::json::wvalue{
-                {"type", "Your Username"},
-                {"username",
-                 newUsername}}.dump());
-            for (auto *other : wsrooms[connData.roomId].connections) {
-              if (other != &conn) {
-                other->send_text(crow::json::wvalue{
-                    {"type", "Username Change"},
-                    {"oldUsername", oldUsername},
-                    {"newUsername",
-                     newUsername}}.dump());
-              }
-            }
-          }
+        Command cmd;
+        if (is_binary) {
+          if (!decode_command(message, cmd))
+            return;
+        } else {
+          auto json = crow::json::load(message);
+          if (!json)
+            return;
+          cmd = decode_command(json);
         }
-        if (type == "Change Team") {
-          std::string newTeam = json["newTeam"].s();
-          std::lock_guard<std::mutex> lock(rooms_mutex);
-          auto it = connections.find(&conn);
-          if (it != connections.end()) {
-            ConnData &connData = it->second;
-            auto username = connData.player.username;
-            connData.player.team = newTeam;
-            wsrooms[connData.roomId].players[&conn].team = newTeam;
-            conn.send_text(crow::json::wvalue{
-                {"type", "Your Team"},
-                {"team",
-                 newTeam}}.dump());
-            for (auto *other : wsrooms[connData.roomId].connections) {
-              if (other != &conn) {
-                other->send_text(crow::json::wvalue{
-                    {"type", "Team Change"},
-                    {"username", username},
-                    {"team",
-                     newTeam}}.dump());
-              }
-            }
+
+        if (cd->room->commands.push(
+                RoomCommand{std::move(cmd), &conn, cd->slot, cd->outbox}))
+          drain_commands(cd->room);
+      })
+      // Crow runs the close handler after an error too, so cleanup lives
+      // there.
+      .onerror([&](crow::websocket::connection &, const std::string &error) {
+        metrics.add(connectionErrors);
+        CROW_LOG_WARNING << "WebSocket error: " << error;
+      })
+      // Crow >= 1.2 also passes the close status code.
+      .onclose([&](crow::websocket::connection &conn, const std::string &,
+                   auto...) {
+        auto *cd = static_cast<ConnData *>(conn.userdata());
+        if (cd) {
+          if (cd->outbox) {
+            cd->outbox->close();
+            metrics.add(connectionsClosed);
+          }
+          Room &room = *cd->room;
+          if (cd->spectator()) {
+            room.spectators->remove(&conn);
+            if (cd->outbox)
+              metrics.add(spectatorsLeft);
+            delete cd;
+            conn.userdata(nullptr);
+            return;
           }
+          Room::Lock lock(room);
+          room.players.detach(&conn);
+          if (!room.players.online(cd->slot))
+            schedule_expiry(room, cd->slot);
+          if (room.players.connections().empty())
+            room.idle_since = std::chrono::steady_clock::now();
         }
+        delete cd;
+        conn.userdata(nullptr);
       });
 
-  app.loglevel(crow::LogLevel::Debug);
-  app.port(18080).multithreaded().run();
+  app.tick(std::chrono::milliseconds(1), [] { lotTimers.advance(); });
+  const char *tick = std::getenv("SPECTATOR_TICK_MS");
+  spectatorHub.start(std::chrono::milliseconds(
+      std::max(1L, tick ? std::strtol(tick, nullptr, 10) : 100L)));
+  // OUTBOX_DRAIN_KBPS: the rate a client is assumed to read at; see outbox.h.
+  const char *drain = std::getenv("OUTBOX_DRAIN_KBPS");
+  outboxPacer.start(std::chrono::milliseconds(10),
+                    drain ? std::strtoul(drain, nullptr, 10) << 10
+                          : decltype(outboxPacer)::kDefaultDrainRate);
+  commandExecutor.start(std::thread::hardware_concurrency());
+  app.port(port).multithreaded().run();
+  spectatorHub.stop();
+  commandExecutor.stop();
+  outboxPacer.stop();
+  eventLog.stop();
+  logHandler.stop();
+  return 0;
+}
+
+//   server [--port 18080] [--workers N]
+//
+// With N > 1 the process forks N workers listening on port+1..port+N and
+// routes the public port to them by room. Each worker journals under
+// journal/<index>; keep N fixed across restarts so recovered rooms stay with
+// the worker their ids map to.
+int main(int argc, char **argv) {
+  int port = 18080;
+  unsigned workers = 1;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string flag = argv[i];
+    std::string value = argv[i + 1];
+    if (flag == "--port")
+      port = std::stoi(value);
+    else if (flag == "--workers")
+      workers = static_cast<unsigned>(
+          std::clamp(std::stoi(value), 1,
+                     static_cast<int>(cluster::kRoomIdChars.size())));
+  }
+  if (workers == 1)
+    return serve(port);
+
+  std::vector<Endpoint> endpoints;
+  for (unsigned i = 0; i < workers; ++i) {
+    endpoints.push_back(Endpoint{"127.0.0.1", port + 1 + static_cast<int>(i)});
+    pid_t pid = ::fork();
+    if (pid < 0) {
+      CROW_LOG_CRITICAL << "fork failed: " << std::strerror(errno);
+      return 1;
+    }
+    if (pid == 0) {
+      // Workers go down with the router.
+      ::prctl(PR_SET_PDEATHSIG, SIGTERM);
+      workerIndex = i;
+      workerCount = workers;
+      routerPort = port;
+      return serve(endpoints.back().port);
+    }
+  }
+  CROW_LOG_INFO << "Routing port " << port << " to " << workers
+                << " workers";
+  cluster::Router router(port, endpoints);
+  if (!router.run()) {
+    CROW_LOG_CRITICAL << "Cannot listen on port " << port;
+    return 1;
+  }
+  return 0;
 }
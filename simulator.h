@@ -0,0 +1,269 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "auction.h"
+#include "results.h"
+#include "rng.h"
+
+// Headless auctions between synthetic bidders, run through the same Auction
+// bid and squad rules as the server. Each auction draws from its own
+// generator seeded from (seed, auction index) and keeps a simulated clock, so
+// the totals are the same for a given seed whatever the thread count or
+// scheduling.
+
+struct SimConfig {
+  std::uint64_t seed = 1;
+  std::size_t auctions = 1000;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  int teams = 10;
+  SquadRules rules;
+  // Lot timer: a lot closes this long after its last bid.
+  std::chrono::milliseconds bid_timeout{20000};
+  // Mean time an interested bidder takes to raise.
+  std::chrono::milliseconds mean_think{2500};
+};
+
+struct SimTotals {
+  std::uint64_t auctions = 0;
+  std::uint64_t lots = 0;
+  std::uint64_t sold = 0;
+  std::uint64_t bids = 0;
+  // Lots on which an agent wanted to bid but the squad rules stopped it,
+  // counted once per agent and lot.
+  std::uint64_t refusals = 0;
+  std::int64_t base_lakhs = 0;  // base price of the players sold
+  std::int64_t spent_lakhs = 0; // what they sold for
+  std::int64_t simulated_ms = 0;
+  // Order-sensitive hash of every sale; equal runs give equal checksums.
+  std::uint64_t checksum = 0;
+
+  void merge(const SimTotals &other) {
+    auctions += other.auctions;
+    lots += other.lots;
+    sold += other.sold;
+    bids += other.bids;
+    refusals += other.refusals;
+    base_lakhs += other.base_lakhs;
+    spent_lakhs += other.spent_lakhs;
+    simulated_ms += other.simulated_ms;
+    checksum = (checksum ^ other.checksum) * 0x100000001b3ull;
+  }
+};
+
+namespace sim {
+
+enum class Strategy : std::uint8_t { Conservative, Balanced, Aggressive };
+
+struct Agent {
+  std::string team;
+  std::uint16_t id; // in Auction::teams()
+  Strategy strategy;
+};
+
+// The most this agent would pay for a player with the given base price;
+// zero when it will not bid at all.
+inline Money valuation(const Agent &agent, Money base, FastRng &rng) {
+  // Percent of base price: a spread per strategy.
+  std::uint64_t low = 100, spread = 50;
+  switch (agent.strategy) {
+  case Strategy::Conservative:
+    break;
+  case Strategy::Balanced:
+    spread = 200;
+    break;
+  case Strategy::Aggressive:
+    low = 150;
+    spread = 450;
+    break;
+  }
+  // Roughly a third of players do not interest a given team.
+  if (rng.below(3) == 0)
+    return Money();
+  auto percent = static_cast<std::int64_t>(low + rng.below(spread + 1));
+  return Money::lakhs(static_cast<std::int32_t>(base.lakhs() * percent / 100));
+}
+
+// Exponentially distributed think time with the given mean, in ms.
+inline std::int64_t think_ms(std::int64_t mean, FastRng &rng) {
+  double u = (static_cast<double>(rng() >> 11) + 0.5) * 0x1.0p-53;
+  return static_cast<std::int64_t>(-std::log(u) * static_cast<double>(mean));
+}
+
+// With `results`, every lot's outcome is appended to it once the auction
+// ends.
+inline SimTotals run_auction(const SimConfig &config, const Catalog &catalog,
+                             const std::vector<std::string> &sets,
+                             std::size_t index,
+                             ResultsStore *results = nullptr) {
+  FastRng rng(config.seed ^ (0x9e3779b97f4a7c15ull * (index + 1)));
+  SimTotals totals;
+  totals.auctions = 1;
+
+  Auction auction(config.rules);
+  std::vector<Agent> agents;
+  for (int t = 0; t < config.teams; ++t) {
+    std::string team = "Team " + std::to_string(t + 1);
+    auction.intern_team(team);
+    agents.push_back(Agent{team, auction.teams().find(team),
+                           static_cast<Strategy>(rng.below(3))});
+  }
+
+  auction.start(catalog, plan_lots(catalog, sets, rng()));
+  const Squads &squads = auction.squads();
+  std::vector<Money> limits(agents.size());
+  // Agents the squad rules already stopped on this lot; each counts once.
+  std::vector<bool> refused(agents.size());
+  const std::int64_t timeout = config.bid_timeout.count();
+  std::int64_t now = 0;
+  std::vector<ResultsStore::Row> rows;
+  while (auction.has_lot()) {
+    std::uint32_t player = auction.current_player();
+    Money base = catalog.base_price(player);
+    for (std::size_t a = 0; a < agents.size(); ++a)
+      limits[a] = valuation(agents[a], base, rng);
+    refused.assign(agents.size(), false);
+
+    for (;;) {
+      Money next = auction.next_bid();
+      const std::string &high = auction.high_bidder();
+      std::size_t bidder = agents.size();
+      std::int64_t soonest = timeout;
+      for (std::size_t a = 0; a < agents.size(); ++a) {
+        if (agents[a].team == high || limits[a] < next)
+          continue;
+        if (squads.check(catalog, agents[a].id, player, next) !=
+            Squads::Check::Ok) {
+          if (!refused[a]) {
+            refused[a] = true;
+            ++totals.refusals;
+          }
+          continue;
+        }
+        std::int64_t delay = think_ms(config.mean_think.count(), rng);
+        if (delay < soonest) {
+          soonest = delay;
+          bidder = a;
+        }
+      }
+      if (bidder == agents.size()) {
+        now += timeout;
+        break;
+      }
+      now += soonest;
+      if (auction.place_bid(agents[bidder].team, next) ==
+          Auction::BidResult::Accepted)
+        ++totals.bids;
+    }
+
+    auto result = auction.close_lot();
+    ++totals.lots;
+    if (result.sold()) {
+      ++totals.sold;
+      totals.base_lakhs += catalog.base_price(result.player).lakhs();
+      totals.spent_lakhs += result.price.lakhs();
+      totals.checksum =
+          (totals.checksum ^ (std::uint64_t{result.player} << 32 |
+                              static_cast<std::uint32_t>(result.price.lakhs())))
+          * 0x100000001b3ull;
+    }
+    if (results)
+      rows.push_back(ResultsStore::Row{result.player, std::move(result.team),
+                                       result.price, result.bids});
+  }
+  if (results)
+    results->append(catalog, rows);
+  totals.simulated_ms = now;
+  return totals;
+}
+
+// Calls body(i) for every i in [0, n) on `threads` threads. Each thread
+// starts on an equal slice; one that runs dry steals the upper half of the
+// largest slice left, so a few long auctions do not leave threads idle.
+template <typename Body>
+void parallel_for(std::size_t n, unsigned threads, Body &&body) {
+  struct alignas(64) Slice {
+    std::mutex mutex;
+    std::size_t begin = 0;
+    std::size_t end = 0;
+  };
+  threads = std::max(1u, threads);
+  std::vector<Slice> slices(threads);
+  for (unsigned t = 0; t < threads; ++t) {
+    slices[t].begin = n * t / threads;
+    slices[t].end = n * (t + 1) / threads;
+  }
+
+  auto take = [&](unsigned self, std::size_t &i) {
+    {
+      std::lock_guard<std::mutex> lock(slices[self].mutex);
+      if (slices[self].begin < slices[self].end) {
+        i = slices[self].begin++;
+        return true;
+      }
+    }
+    for (;;) {
+      unsigned victim = threads;
+      std::size_t most = 1;
+      for (unsigned t = 0; t < threads; ++t) {
+        std::lock_guard<std::mutex> lock(slices[t].mutex);
+        if (slices[t].end - slices[t].begin > most) {
+          most = slices[t].end - slices[t].begin;
+          victim = t;
+        }
+      }
+      // Nothing worth splitting: the owners finish what is left.
+      if (victim == threads)
+        return false;
+      std::size_t begin, end;
+      {
+        std::lock_guard<std::mutex> lock(slices[victim].mutex);
+        Slice &slice = slices[victim];
+        if (slice.end - slice.begin < 2)
+          continue;
+        end = slice.end;
+        begin = slice.end = slice.begin + (slice.end - slice.begin) / 2;
+      }
+      std::lock_guard<std::mutex> lock(slices[self].mutex);
+      slices[self].begin = begin + 1;
+      slices[self].end = end;
+      i = begin;
+      return true;
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      std::size_t i;
+      while (take(t, i))
+        body(i);
+    });
+  }
+  for (auto &worker : workers)
+    worker.join();
+}
+
+// Runs config.auctions auctions and sums them in index order. Outcomes go
+// to `store` if given, each auction's lots together but the auctions in
+// whatever order they finish.
+inline SimTotals run(const SimConfig &config, const Catalog &catalog,
+                     const std::vector<std::string> &sets,
+                     ResultsStore *store = nullptr) {
+  std::vector<SimTotals> results(config.auctions);
+  parallel_for(config.auctions, config.threads, [&](std::size_t i) {
+    results[i] = run_auction(config, catalog, sets, i, store);
+  });
+  SimTotals totals;
+  for (const auto &result : results)
+    totals.merge(result);
+  return totals;
+}
+
+} // namespace sim
@@ -0,0 +1,250 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "outbox.h"
+#include "protocol.h"
+
+// A room's spectators: watchers outside the player table who see the lots
+// and bids but take no part. Players get each event the moment it happens;
+// spectators get the room's state at most once a tick of the SpectatorHub.
+// Between ticks a newer bid replaces an older one, and a lot event (Lot
+// Open, Lot Closed, Auction Complete) drops the bids before it. Every
+// spectator is sent the same frames, encoded once by the room.
+//
+// The room publishes under its own lock and only touches the pending state;
+// the hub's thread does the fan-out under the watcher lock, so thousands of
+// spectators add nothing to the bid path but a frame swap.
+template <typename Connection> class SpectatorTier {
+public:
+  using OutboxPtr = std::shared_ptr<Outbox<Connection>>;
+
+  // Coalescing key of bid frames in a spectator's outbox, so one that falls
+  // behind holds only the latest.
+  static constexpr std::uint64_t kBidKey = 1;
+
+  // Returns true if the tier now needs a delivery; the caller then hands it
+  // to the hub. The newcomer is sent the current state on that delivery.
+  bool add(Connection *conn, OutboxPtr outbox) {
+    {
+      std::unique_lock<std::mutex> lock(watchers_mutex_);
+      // Arrived after close_all(): sent off the same way.
+      if (last_.json) {
+        Frames last = last_;
+        lock.unlock();
+        if (outbox->finish(last, kClosedReason))
+          outbox->flush();
+        return false;
+      }
+      index_.emplace(conn, watchers_.size());
+      watchers_.push_back(Watcher{conn, std::move(outbox), true});
+      count_.store(watchers_.size(), std::memory_order_relaxed);
+    }
+    return mark();
+  }
+
+  void remove(Connection *conn) {
+    std::lock_guard<std::mutex> lock(watchers_mutex_);
+    auto it = index_.find(conn);
+    if (it == index_.end())
+      return;
+    std::size_t i = it->second;
+    index_.erase(it);
+    if (i + 1 != watchers_.size()) {
+      watchers_[i] = std::move(watchers_.back());
+      index_[watchers_[i].conn] = i;
+    }
+    watchers_.pop_back();
+    count_.store(watchers_.size(), std::memory_order_relaxed);
+  }
+
+  std::size_t size() const { return count_.load(std::memory_order_relaxed); }
+
+  // Sends every spectator `last` and then closes them, as does add() from
+  // then on. For a room being freed.
+  void close_all(const Frames &last) {
+    std::vector<Watcher> watchers;
+    {
+      std::lock_guard<std::mutex> lock(watchers_mutex_);
+      last_ = last;
+      watchers.swap(watchers_);
+      index_.clear();
+      count_.store(0, std::memory_order_relaxed);
+    }
+    // Flushed after the lock, as in deliver().
+    for (auto &watcher : watchers) {
+      if (watcher.outbox->finish(last, kClosedReason))
+        watcher.outbox->flush();
+    }
+  }
+
+  // A lot event. Returns true if the tier needs a delivery.
+  bool publish_lot(Frames frames) {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    lot_ = frames;
+    bid_ = Frames{};
+    pending_bid_ = Frames{};
+    // With nobody watching only the state is kept, for whoever comes.
+    if (size() != 0)
+      pending_lots_.push_back(std::move(frames));
+    return mark_locked();
+  }
+
+  // The open lot's latest bid. Returns true if the tier needs a delivery.
+  bool publish_bid(Frames frames) {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    bid_ = frames;
+    pending_bid_ = std::move(frames);
+    return mark_locked();
+  }
+
+  // Sends what was published since the last delivery to every spectator,
+  // and the current state to those added since. Runs on the hub's thread.
+  void deliver() {
+    std::vector<std::pair<Frames, std::uint64_t>> batch;
+    std::vector<std::pair<Frames, std::uint64_t>> state;
+    {
+      std::lock_guard<std::mutex> lock(pending_mutex_);
+      for (auto &frames : pending_lots_)
+        batch.emplace_back(std::move(frames), 0);
+      pending_lots_.clear();
+      if (pending_bid_.json)
+        batch.emplace_back(std::move(pending_bid_), kBidKey);
+      pending_bid_ = Frames{};
+      if (lot_.json)
+        state.emplace_back(lot_, 0);
+      if (bid_.json)
+        state.emplace_back(bid_, kBidKey);
+      dirty_ = false;
+    }
+
+    // Flushed after the lock: a flush that evicts a spectator can run its
+    // close handler inline, and that calls remove().
+    std::vector<OutboxPtr> ready;
+    {
+      std::lock_guard<std::mutex> lock(watchers_mutex_);
+      for (auto &watcher : watchers_) {
+        bool idle = false;
+        for (const auto &[frames, key] : watcher.fresh ? state : batch)
+          idle |= watcher.outbox->push(frames, key);
+        watcher.fresh = false;
+        if (idle)
+          ready.push_back(watcher.outbox);
+      }
+    }
+    for (auto &outbox : ready)
+      outbox->flush();
+  }
+
+private:
+  static constexpr const char *kClosedReason = "Room closed";
+
+  struct Watcher {
+    Connection *conn;
+    OutboxPtr outbox;
+    // Added since the last delivery; gets the state instead of the batch.
+    bool fresh;
+  };
+
+  bool mark() {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    return mark_locked();
+  }
+  // Nobody to deliver to, or a delivery already due: nothing to schedule.
+  bool mark_locked() {
+    if (dirty_ || size() == 0)
+      return false;
+    dirty_ = true;
+    return true;
+  }
+
+  std::mutex watchers_mutex_;
+  std::vector<Watcher> watchers_;
+  std::unordered_map<Connection *, std::size_t> index_;
+  std::atomic<std::size_t> count_{0};
+  // Set by close_all().
+  Frames last_;
+
+  std::mutex pending_mutex_;
+  // The latest lot event and the bid after it, for new spectators.
+  Frames lot_;
+  Frames bid_;
+  // Published since the last delivery.
+  std::vector<Frames> pending_lots_;
+  Frames pending_bid_;
+  bool dirty_ = false;
+};
+
+// Delivers every room's spectator updates from one thread, once a tick.
+template <typename Connection> class SpectatorHub {
+public:
+  using Tier = SpectatorTier<Connection>;
+
+  SpectatorHub() = default;
+  ~SpectatorHub() { stop(); }
+  SpectatorHub(const SpectatorHub &) = delete;
+  SpectatorHub &operator=(const SpectatorHub &) = delete;
+
+  void start(std::chrono::milliseconds tick) {
+    tick_ = tick;
+    thread_ = std::thread([this] { run(); });
+  }
+
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopping_ || !thread_.joinable())
+        return;
+      stopping_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+  }
+
+  // Queues the tier for the next tick; see SpectatorTier's publish and add.
+  void schedule(std::shared_ptr<Tier> tier) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    due_.push_back(std::move(tier));
+  }
+
+  std::uint64_t deliveries() const {
+    return deliveries_.load(std::memory_order_relaxed);
+  }
+
+private:
+  void run() {
+    std::vector<std::shared_ptr<Tier>> due;
+    auto next = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+      next += tick_;
+      wake_.wait_until(lock, next, [this] { return stopping_; });
+      due.swap(due_);
+      lock.unlock();
+      for (auto &tier : due)
+        tier->deliver();
+      deliveries_.fetch_add(due.size(), std::memory_order_relaxed);
+      due.clear();
+      lock.lock();
+      // After a stall, tick from now rather than catching up.
+      next = std::max(next, std::chrono::steady_clock::now() - tick_);
+    }
+  }
+
+  std::chrono::milliseconds tick_{100};
+  std::vector<std::shared_ptr<Tier>> due_;
+  std::atomic<std::uint64_t> deliveries_{0};
+  bool stopping_ = false;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::thread thread_;
+};
@@ -0,0 +1,118 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "catalog.h"
+#include "money.h"
+
+// The limits every team in an auction buys under. The defaults are the
+// IPL's.
+struct SquadRules {
+  Money purse = Money::lakhs(12000);
+  int max_players = 25;
+  // A team must be able to fill this many slots, so it may not spend the
+  // base price of the ones still empty.
+  int min_players = 18;
+  int max_overseas = 8;
+  // Players from any other country count as overseas.
+  std::string home_country = "India";
+};
+
+// One team's buys so far, as running totals.
+struct Squad {
+  static constexpr std::size_t kMaxRoles = 8;
+
+  Money spent;
+  std::uint16_t players = 0;
+  std::uint16_t overseas = 0;
+  std::uint16_t uncapped = 0;
+  // Players per Catalog::role_id; roles past kMaxRoles are not counted.
+  std::array<std::uint16_t, kMaxRoles> roles{};
+  // The most the team may bid on the next lot, kept current by every sale.
+  Money max_bid;
+};
+
+// Every team's squad in one auction, indexed by the auction's team ids.
+// Sales update a team's totals and its max bid as they happen, so checking
+// a bid is a few comparisons. Not thread-safe: used under the room's lock.
+class Squads {
+public:
+  enum class Check { Ok, OverPurse, SquadFull, OverseasFull };
+
+  explicit Squads(SquadRules rules = {}) : rules_(std::move(rules)) {
+    empty_.max_bid = max_bid_for(empty_);
+  }
+
+  const SquadRules &rules() const { return rules_; }
+
+  // Starts over with no sales, for an auction of `catalog`'s players.
+  void reset(const Catalog &catalog) {
+    squads_.clear();
+    home_ = catalog.countries().find(rules_.home_country);
+    uncapped_ = catalog.cap_statuses().find("Uncapped");
+    min_base_ = Money();
+    for (std::uint32_t i = 0; i < catalog.size(); ++i) {
+      Money base = catalog.base_price(i);
+      if (i == 0 || base < min_base_)
+        min_base_ = base;
+    }
+    empty_.max_bid = max_bid_for(empty_);
+  }
+
+  bool overseas(const Catalog &catalog, std::uint32_t player) const {
+    return catalog.country_id(player) != home_;
+  }
+
+  // Whether `team` may bid `amount` for `player`.
+  Check check(const Catalog &catalog, std::uint16_t team,
+              std::uint32_t player, Money amount) const {
+    const Squad &squad = (*this)[team];
+    if (squad.players >= rules_.max_players)
+      return Check::SquadFull;
+    if (squad.overseas >= rules_.max_overseas && overseas(catalog, player))
+      return Check::OverseasFull;
+    if (amount > squad.max_bid)
+      return Check::OverPurse;
+    return Check::Ok;
+  }
+
+  void record_sale(const Catalog &catalog, std::uint16_t team,
+                   std::uint32_t player, Money price) {
+    if (team >= squads_.size())
+      squads_.resize(team + 1u, empty_);
+    Squad &squad = squads_[team];
+    squad.spent += price;
+    ++squad.players;
+    if (overseas(catalog, player))
+      ++squad.overseas;
+    if (catalog.cap_status_id(player) == uncapped_)
+      ++squad.uncapped;
+    if (catalog.role_id(player) < Squad::kMaxRoles)
+      ++squad.roles[catalog.role_id(player)];
+    squad.max_bid = max_bid_for(squad);
+  }
+
+  // A team with no sales reads as an empty squad.
+  const Squad &operator[](std::uint16_t team) const {
+    return team < squads_.size() ? squads_[team] : empty_;
+  }
+
+private:
+  // Purse left, less the cheapest base price for each slot still needed
+  // after this one to reach min_players.
+  Money max_bid_for(const Squad &squad) const {
+    int owed = std::max(0, rules_.min_players - squad.players - 1);
+    return rules_.purse - squad.spent - Money::lakhs(min_base_.lakhs() * owed);
+  }
+
+  SquadRules rules_;
+  std::vector<Squad> squads_;
+  Squad empty_;
+  std::uint16_t home_ = 0;
+  std::uint16_t uncapped_ = 0;
+  Money min_base_;
+};
@@ -0,0 +1,214 @@
+#pragma once
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdint>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+// Minimal blocking HTTP and WebSocket client for the load tools: just enough
+// of both protocols to drive server.cpp over plain TCP.
+
+struct Endpoint {
+  std::string host = "127.0.0.1";
+  int port = 18080;
+};
+
+// A nonzero timeout bounds the connect and each later send and recv.
+inline int connect_to(const Endpoint &server,
+                      std::chrono::milliseconds timeout = {}) {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (timeout.count() > 0) {
+    timeval tv{};
+    tv.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+    tv.tv_usec = static_cast<suseconds_t>(timeout.count() % 1000 * 1000);
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  }
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(server.port);
+  ::inet_pton(AF_INET, server.host.c_str(), &addr.sin_addr);
+  if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  int one = 1;
+  ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return fd;
+}
+
+inline bool write_all(int fd, const std::string &data) {
+  std::size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, 0);
+    if (n <= 0)
+      return false;
+    sent += n;
+  }
+  return true;
+}
+
+// Pulls the raw value of "key" out of a flat JSON object as dumped by Crow.
+inline std::string json_field(const std::string &json,
+                              const std::string &key) {
+  std::string needle = "\"" + key + "\":";
+  auto pos = json.find(needle);
+  if (pos == std::string::npos)
+    return {};
+  pos += needle.size();
+  if (pos < json.size() && json[pos] == '"') {
+    auto end = json.find('"', pos + 1);
+    return json.substr(pos + 1, end - pos - 1);
+  }
+  auto end = json.find_first_of(",}", pos);
+  return json.substr(pos, end - pos);
+}
+
+struct HttpResult {
+  int status = 0;
+  std::string token;
+  std::string body;
+};
+
+// Status 0 if the server could not be reached or did not answer in time.
+inline HttpResult http_request(const Endpoint &server,
+                                const std::string &method,
+                                const std::string &path,
+                                std::chrono::milliseconds timeout = {}) {
+  HttpResult result;
+  int fd = connect_to(server, timeout);
+  if (fd < 0)
+    return result;
+  write_all(fd, method + " " + path + " HTTP/1.1\r\nHost: " + server.host +
+                    "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+  std::string response;
+  char buf[4096];
+  ssize_t n;
+  while ((n = ::recv(fd, buf, sizeof(buf), 0)) > 0)
+    response.append(buf, n);
+  ::close(fd);
+
+  if (response.size() > 12)
+    result.status = std::stoi(response.substr(9, 3));
+  auto cookie = response.find("token=");
+  if (cookie != std::string::npos)
+    result.token = response.substr(
+        cookie + 6, response.find_first_of(";\r", cookie) - cookie - 6);
+  auto body = response.find("\r\n\r\n");
+  if (body != std::string::npos)
+    result.body = response.substr(body + 4);
+  return result;
+}
+
+inline HttpResult http_post(const Endpoint &server, const std::string &path) {
+  return http_request(server, "POST", path);
+}
+
+inline HttpResult http_get(const Endpoint &server, const std::string &path,
+                           std::chrono::milliseconds timeout = {}) {
+  return http_request(server, "GET", path, timeout);
+}
+
+class WsClient {
+public:
+  ~WsClient() {
+    if (fd_ >= 0)
+      ::close(fd_);
+  }
+
+  bool open(const Endpoint &server, const std::string &token) {
+    fd_ = connect_to(server);
+    if (fd_ < 0)
+      return false;
+    write_all(fd_, "GET /wsrooms HTTP/1.1\r\nHost: " + server.host +
+                       "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                       "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                       "Sec-WebSocket-Version: 13\r\nCookie: token=" +
+                       token + "\r\n\r\n");
+    std::size_t end;
+    while ((end = buf_.find("\r\n\r\n")) == std::string::npos)
+      if (!read_more())
+        return false;
+    bool upgraded = buf_.compare(9, 3, "101") == 0;
+    buf_.erase(0, end + 4);
+    return upgraded;
+  }
+
+  bool send(const std::string &text) {
+    std::string frame;
+    frame.push_back(static_cast<char>(0x81));
+    if (text.size() < 126) {
+      frame.push_back(static_cast<char>(0x80 | text.size()));
+    } else if (text.size() < 65536) {
+      frame.push_back(static_cast<char>(0x80 | 126));
+      frame.push_back(static_cast<char>(text.size() >> 8));
+      frame.push_back(static_cast<char>(text.size() & 0xff));
+    } else {
+      frame.push_back(static_cast<char>(0x80 | 127));
+      for (int i = 7; i >= 0; --i)
+        frame.push_back(static_cast<char>((text.size() >> (8 * i)) & 0xff));
+    }
+    const unsigned char mask[4] = {0x5a, 0x17, 0xc3, 0x9e};
+    frame.append(reinterpret_cast<const char *>(mask), 4);
+    for (std::size_t i = 0; i < text.size(); ++i)
+      frame.push_back(static_cast<char>(text[i] ^ mask[i % 4]));
+    return write_all(fd_, frame);
+  }
+
+  // Blocks for the next text or binary message; false once the peer closes.
+  bool receive(std::string &message) {
+    while (true) {
+      if (buf_.size() >= 2) {
+        auto *p = reinterpret_cast<const unsigned char *>(buf_.data());
+        int opcode = p[0] & 0x0f;
+        std::size_t header = 2;
+        std::uint64_t len = p[1] & 0x7f;
+        if (len == 126) {
+          header = 4;
+          len = buf_.size() >= 4 ? (p[2] << 8) | p[3] : 0;
+        } else if (len == 127) {
+          header = 10;
+          len = 0;
+          for (int i = 0; i < 8 && buf_.size() >= 10; ++i)
+            len = (len << 8) | p[2 + i];
+        }
+        if (buf_.size() >= header && buf_.size() - header >= len) {
+          std::string payload = buf_.substr(header, len);
+          buf_.erase(0, header + len);
+          if (opcode == 0x8)
+            return false;
+          if (opcode == 0x1 || opcode == 0x2) {
+            message = std::move(payload);
+            return true;
+          }
+          continue;
+        }
+      }
+      if (!read_more())
+        return false;
+    }
+  }
+
+  // Unblocks a receive() in progress on another thread.
+  void shutdown() {
+    if (fd_ >= 0)
+      ::shutdown(fd_, SHUT_RDWR);
+  }
+
+private:
+  bool read_more() {
+    char buf[16384];
+    ssize_t n = ::recv(fd_, buf, sizeof(buf), 0);
+    if (n <= 0)
+      return false;
+    buf_.append(buf, n);
+    return true;
+  }
+
+  int fd_ = -1;
+  std::string buf_;
+};